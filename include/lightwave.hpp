@@ -10,10 +10,12 @@
 #include <lightwave/core.hpp>
 #include <lightwave/logger.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/options.hpp>
 #include <lightwave/properties.hpp>
 #include <lightwave/registry.hpp>
 
 // MARK: - utilities
+#include <lightwave/distribution.hpp>
 #include <lightwave/iterators.hpp>
 #include <lightwave/parallel.hpp>
 #include <lightwave/streaming.hpp>
@@ -48,6 +48,24 @@ struct BsdfEval {
     bool isInvalid() const { return value == Color(0); }
 };
 
+/**
+ * @brief The texture values of a Bsdf at a surface point, which the Bsdf evaluates once (see @ref Bsdf::prepare ) so
+ * that all queries at that point (sampling, evaluation, density and albedo) can share them.
+ * The meaning of the values is up to the Bsdf.
+ */
+struct PreparedBsdf {
+    /// @brief The Bsdf that prepared the values, or nullptr if none have been prepared yet.
+    const Bsdf *bsdf = nullptr;
+    /// @brief The texture coordinates the values have been prepared for.
+    Point2 uv;
+    /// @brief A color valued texture value.
+    Color color;
+    /// @brief Scalar texture values.
+    float scalars[3] = {};
+    /// @brief The width of the area the textures are filtered over, in texture coordinates (see @ref Intersection::uvFootprint ).
+    float footprint = 0;
+};
+
 /// @brief A Bsdf, representing the scattering distribution of a surface.
 class Bsdf : public Object {
 public:
@@ -65,6 +83,22 @@ public:
                               const Vector &wi) const {
         NOT_IMPLEMENTED
     }
+    /**
+     * @brief Returns the solid angle density with which @ref sample produces
+     * the direction @c wi (in local coordinates), as needed for multiple
+     * importance sampling.
+     * @note Dirac distributions (e.g., perfect mirrors) report a density of
+     * zero, as light sampling can never find the directions they produce.
+     * @param uv The texture coordinates of the surface.
+     * @param wo The outgoing direction light is scattered in, pointing away
+     * from the surface, in local coordinates.
+     * @param wi The incoming direction light comes from, pointing away
+     * from the surface, in local coordinates.
+     */
+    virtual float pdf(const Point2 &uv, const Vector &wo,
+                      const Vector &wi) const {
+        NOT_IMPLEMENTED
+    }
     /**
      * @brief Samples a direction according to the distribution of the Bsdf in
      * local coordinates (i.e., the normal is assumed to be [0,0,1]).
@@ -79,6 +113,60 @@ public:
                               Sampler &rng) const = 0;
 
     virtual Color albedo(const Point2 &uv) const = 0;
+
+    /**
+     * @brief Evaluates the textures of the Bsdf at @c prepared.uv into @c prepared , so that repeated queries of the
+     * same surface point through the @c Prepared variants below do not need to look them up again.
+     * Bsdfs that do not override this (e.g., as they only look up a single texture per query) leave @c prepared
+     * unchanged, and their @c Prepared variants forward to the regular queries at @c prepared.uv .
+     */
+    virtual void prepare(PreparedBsdf &prepared) const {}
+
+    /**
+     * @brief Returns the texture values of the Bsdf at a given texture coordinate (see @ref prepare ), filtered over
+     * the given footprint in texture space.
+     */
+    PreparedBsdf prepareAt(const Point2 &uv, float footprint = 0) const {
+        PreparedBsdf prepared;
+        prepared.bsdf      = this;
+        prepared.uv        = uv;
+        prepared.footprint = footprint;
+        prepare(prepared);
+        return prepared;
+    }
+
+    /// @brief Variant of @ref evaluate that uses texture values from @ref prepare .
+    virtual BsdfEval evaluatePrepared(const PreparedBsdf &prepared,
+                                      const Vector &wo, const Vector &wi) const {
+        return evaluate(prepared.uv, wo, wi);
+    }
+    /// @brief Variant of @ref pdf that uses texture values from @ref prepare .
+    virtual float pdfPrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              const Vector &wi) const {
+        return pdf(prepared.uv, wo, wi);
+    }
+    /// @brief Variant of @ref sample that uses texture values from @ref prepare .
+    virtual BsdfSample samplePrepared(const PreparedBsdf &prepared,
+                                      const Vector &wo, Sampler &rng) const {
+        return sample(prepared.uv, wo, rng);
+    }
+    /// @brief Variant of @ref albedo that uses texture values from @ref prepare .
+    virtual Color albedoPrepared(const PreparedBsdf &prepared) const {
+        return albedo(prepared.uv);
+    }
+
+    /**
+     * @brief Reports whether the Bsdf reflects light equally into all outgoing
+     * directions (i.e., @ref evaluate does not depend on @c wo ), which allows
+     * caching the radiance reflected by the surface.
+     */
+    virtual bool isDiffuse() const { return false; }
+
+    /**
+     * @brief Reports whether the Bsdf only scatters light into discrete directions (e.g., perfect mirrors and glass),
+     * which keeps the footprint of rays narrow (see @ref Ray::width ).
+     */
+    virtual bool isSpecular() const { return false; }
 };
 
 } // namespace lightwave
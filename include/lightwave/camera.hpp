@@ -22,6 +22,42 @@ struct CameraSample {
     Color weight;
 };
 
+/// @brief The result of connecting a point in the scene to the camera using @ref Camera::sampleDirect .
+struct CameraDirectSample {
+    /// @brief The pixel the point is seen in.
+    Point2i pixel;
+    /// @brief The direction vector, pointing from the point towards the camera.
+    Vector wi;
+    /// @brief The distance from the point to the camera.
+    float distance;
+    /**
+     * @brief The importance of the connection divided by its density, which turns the radiance leaving the point
+     * towards the camera into an estimate of the value of @c pixel .
+     */
+    Color weight;
+    /**
+     * @brief The solid angle density with which the camera samples the direction towards the point (when sampling all
+     * pixels uniformly), used for multiple importance sampling.
+     */
+    float pdf;
+
+    /// @brief Return an invalid sample, used to denote that the point cannot be seen by the camera.
+    static CameraDirectSample invalid() {
+        return {
+            .pixel = Point2i(0),
+            .wi = Vector(),
+            .distance = 0,
+            .weight = Color(),
+            .pdf = 0,
+        };
+    }
+
+    /// @brief Tests whether the sample is invalid (i.e., the point cannot be seen by the camera).
+    bool isInvalid() const {
+        return weight == Color(0);
+    }
+};
+
 /// @brief A Camera, representing the relationship between pixel coordinates and rays.
 class Camera : public Object {
 protected:
@@ -31,6 +67,12 @@ protected:
     /// @brief The transform that leads from local coordinates to world space coordinates.
     ref<Transform> m_transform;
 
+    /**
+     * @brief The angle that a pixel covers at the center of the image, which sets the spread of camera rays
+     * (see @ref Ray::spread ). Zero if the camera does not support texture filtering.
+     */
+    float m_pixelSpread = 0;
+
 public:
     Camera(const Properties &properties) {
         m_resolution.x() = properties.get<int>("width");
@@ -60,6 +102,20 @@ public:
      * @param rng A random number generator used to steer the sampling.
      */
     virtual CameraSample sample(const Point2 &normalized, Sampler &rng) const = 0;
+
+    /**
+     * @brief Connects a point in the scene to the camera, which allows to trace paths from the lights (e.g., for
+     * bidirectional path tracing). Points that lie outside of the image produce invalid samples.
+     * @note Only meaningful if @ref supportsDirectSampling reports true.
+     * @param origin The point that should be connected to the camera.
+     * @param rng A random number generator used to steer the sampling.
+     */
+    virtual CameraDirectSample sampleDirect(const Point &origin, Sampler &rng) const {
+        return CameraDirectSample::invalid();
+    }
+
+    /// @brief Reports whether the camera implements @ref sampleDirect .
+    virtual bool supportsDirectSampling() const { return false; }
 };
 
 }
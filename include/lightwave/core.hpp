@@ -107,12 +107,14 @@ class Entity;
 class Sampler;
 class Instance;
 struct Intersection;
+struct RayPacket;
 class Color;
 class Image;
 class Texture;
 class Bsdf;
 struct BsdfSample;
 struct BsdfEval;
+struct PreparedBsdf;
 class Light;
 struct DirectLightSample;
 struct DirectLightEval;
@@ -0,0 +1,164 @@
+/**
+ * @file distribution.hpp
+ * @brief Contains discrete and piecewise constant distributions, used to importance sample tabulated quantities
+ * (e.g., the luminance of environment maps).
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief A discrete distribution over the indices [0, N) with probabilities proportional to given weights, which
+ * can be sampled in constant time.
+ * @note Uses the alias method by Walker, with the construction by Vose: every bin holds a threshold and an alias, and
+ * a sample either picks its bin (if its offset within the bin lies below the threshold) or the alias of that bin.
+ */
+class AliasTable {
+    /// @brief The probability of each index.
+    std::vector<float> m_pmf;
+    /// @brief The probability of staying in a bin (instead of jumping to its alias).
+    std::vector<float> m_threshold;
+    /// @brief The index to jump to if the offset within a bin exceeds its threshold.
+    std::vector<int> m_alias;
+    /// @brief The sum of all weights the table has been built from.
+    double m_total = 0;
+
+public:
+    AliasTable() {}
+
+    /// @brief Builds the table for the given (non-negative) weights. If all weights are zero, all indices are equally likely.
+    explicit AliasTable(const std::vector<float> &weights) {
+        const int size = int(weights.size());
+        m_pmf.resize(size);
+        m_threshold.resize(size);
+        m_alias.resize(size);
+
+        m_total = 0;
+        for (float weight : weights) m_total += weight;
+        for (int i = 0; i < size; i++) {
+            m_pmf[i] = m_total > 0 ? float(weights[i] / m_total) : 1.0f / size;
+        }
+
+        // split the bins into those with less and more probability than average, and let the smaller ones be
+        // topped up by the larger ones
+        std::vector<double> scaled(size);
+        std::vector<int> small, large;
+        for (int i = 0; i < size; i++) {
+            scaled[i] = double(m_pmf[i]) * size;
+            (scaled[i] < 1 ? small : large).push_back(i);
+        }
+        while (!small.empty() && !large.empty()) {
+            const int s = small.back();
+            const int l = large.back();
+            small.pop_back();
+            large.pop_back();
+
+            m_threshold[s] = float(scaled[s]);
+            m_alias[s] = l;
+
+            scaled[l] -= 1 - scaled[s];
+            (scaled[l] < 1 ? small : large).push_back(l);
+        }
+        // the remaining bins are (up to rounding errors) exactly full
+        for (int i : small) { m_threshold[i] = 1; m_alias[i] = i; }
+        for (int i : large) { m_threshold[i] = 1; m_alias[i] = i; }
+    }
+
+    /// @brief Returns the number of indices in the distribution.
+    int size() const { return int(m_pmf.size()); }
+    /// @brief Reports whether the table has been built from no weights at all.
+    bool empty() const { return m_pmf.empty(); }
+    /// @brief Returns the sum of the weights the table has been built from.
+    float total() const { return float(m_total); }
+    /// @brief Returns the probability of sampling a given index.
+    float pmf(int index) const { return m_pmf[index]; }
+
+    /**
+     * @brief Samples an index using a uniform random number in [0,1).
+     * @param remapped Receives a fresh uniform random number in [0,1) that is independent of the chosen index, which
+     * allows to reuse the random number for further sampling decisions.
+     */
+    int sample(float rnd, float &remapped) const {
+        // largest float below one, which keeps all offsets and remapped numbers within [0,1)
+        constexpr float OneMinusEpsilon = 1 - std::numeric_limits<float>::epsilon() / 2;
+
+        const float scaled = rnd * size();
+        const int bin = std::min(int(scaled), size() - 1);
+        const float offset = std::min(scaled - bin, OneMinusEpsilon);
+
+        int index;
+        if (offset < m_threshold[bin]) {
+            index = bin;
+            remapped = offset / m_threshold[bin];
+        } else {
+            index = m_alias[bin];
+            remapped = (offset - m_threshold[bin]) / (1 - m_threshold[bin]);
+        }
+        remapped = std::min(remapped, OneMinusEpsilon);
+        return index;
+    }
+
+    /// @brief Samples an index using a uniform random number in [0,1).
+    int sample(float rnd) const {
+        float remapped;
+        return sample(rnd, remapped);
+    }
+};
+
+/**
+ * @brief A piecewise constant distribution over the unit square, given by a grid of (non-negative) weights.
+ * Sampling first picks a row from the marginal distribution and then a column from the conditional distribution of
+ * that row, followed by a uniformly distributed position within the chosen cell.
+ */
+class Distribution2D {
+    /// @brief The number of columns and rows of the grid.
+    Point2i m_resolution;
+    /// @brief The distribution of columns within each row.
+    std::vector<AliasTable> m_conditional;
+    /// @brief The distribution of rows.
+    AliasTable m_marginal;
+
+public:
+    Distribution2D() {}
+
+    /// @brief Builds the distribution for a grid of weights, stored row by row.
+    Distribution2D(const std::vector<float> &weights, const Point2i &resolution)
+    : m_resolution(resolution) {
+        std::vector<float> rowWeights(resolution.y());
+        m_conditional.reserve(resolution.y());
+        for (int y = 0; y < resolution.y(); y++) {
+            const auto row = weights.begin() + std::ptrdiff_t(y) * resolution.x();
+            m_conditional.emplace_back(std::vector<float>(row, row + resolution.x()));
+            rowWeights[y] = m_conditional.back().total();
+        }
+        m_marginal = AliasTable(rowWeights);
+    }
+
+    /// @brief Returns the number of columns and rows of the grid.
+    const Point2i &resolution() const { return m_resolution; }
+
+    /// @brief Warps a uniformly distributed point to the unit square, distributed according to the grid weights.
+    Point2 sample(const Point2 &rnd) const {
+        float remappedX, remappedY;
+        const int y = m_marginal.sample(rnd.y(), remappedY);
+        const int x = m_conditional[y].sample(rnd.x(), remappedX);
+        return {
+            (x + remappedX) / m_resolution.x(),
+            (y + remappedY) / m_resolution.y(),
+        };
+    }
+
+    /// @brief Returns the density of sampling a point in the unit square, with respect to the area of the unit square.
+    float pdf(const Point2 &point) const {
+        const int x = std::clamp(int(point.x() * m_resolution.x()), 0, m_resolution.x() - 1);
+        const int y = std::clamp(int(point.y() * m_resolution.y()), 0, m_resolution.y() - 1);
+        return m_marginal.pmf(y) * m_conditional[y].pmf(x) * m_resolution.x() * m_resolution.y();
+    }
+};
+
+}
@@ -156,6 +156,8 @@ public:
      */
     Color &get(const Point2i &pixel) { return (*this)(pixel); }
 
+    /// @brief Returns the directory the image is saved to by @ref save .
+    const std::filesystem::path &basePath() const { return m_basePath; }
     /// @brief Returns the resolution of this image in pixels.
     const Point2i &resolution() const { return m_resolution; }
     /// @brief Returns the bounding box of this image, ranging from [0,0] to
@@ -7,6 +7,7 @@
 
 #include <lightwave/core.hpp>
 #include <lightwave/shape.hpp>
+#include <lightwave/texture.hpp>
 
 namespace lightwave {
 
@@ -31,9 +32,9 @@ class Instance : public Shape {
     /// @brief The transformation applied to the shape, leading from object coordinates to world coordinates.
     ref<Transform> m_transform;
     /// @brief [RC] The new normal transformation.
-    ref<Texture> m_normal;
+    TextureHandle m_normal;
     /// @brief [RC] The alpha texture.
-    ref<Texture> m_alpha;
+    TextureHandle m_alpha;
     /// @brief Flip the normal direction, used to correct for the change of handedness in case the transformation mirrors the object.
     bool m_flipNormal;
     /// @brief Tracks whether this instance has been added to the scene, i.e., could be hit by ray tracing.
@@ -48,6 +49,12 @@ class Instance : public Shape {
     bool isNormal;
     /// @brief Transforms the frame from object coordinates to world coordinates.
     inline void transformFrame(SurfaceEvent &surf) const;
+    /**
+     * @brief Decides whether an intersection found in object coordinates (for the transformed @c worldRay ) is accepted,
+     * in which case @c its is replaced by its world-space counterpart. Shared by single ray and packet intersection.
+     */
+    bool acceptLocalIntersection(const Ray &worldRay, const Intersection &localIts, bool wasIntersected,
+                                 Intersection &its, Sampler &rng) const;
 
 public:
     Instance(const Properties &properties) 
@@ -94,6 +101,10 @@ public:
     void markAsVisible() override {
         m_visible = true;
     }
+    /// @brief Forwards to the wrapped shape, as the instance itself does not need to know (see @ref Shape::markAsLightSource ).
+    void markAsLightSource() override {
+        m_shape->markAsLightSource();
+    }
     bool getAlbedo() const { return isAlbedo; }
     bool getNormal() const { return isNormal; }
     /// @brief Sets the parent light object that contains this instance.
@@ -102,6 +113,7 @@ public:
             lightwave_throw("instances can only have one light associated with them, %s has multiple!", indent(this));
         }
         m_light = light;
+        m_shape->markAsLightSource();
     }
 
     /**
@@ -112,6 +124,8 @@ public:
      * @return @c true if an intersection was found.
      */
     bool intersect(const Ray &ray, Intersection &its, Sampler &rng) const override;
+    /// @brief Intersects the instance with all active rays of a packet in world coordinates (see @ref Shape::intersectPacket ).
+    RayPacket::Mask intersectPacket(const RayPacket &packet, RayPacket::Mask mask, Intersection *its) const override;
     /// @brief Returns the bounding box of the instance in world coordinates. 
     Bounds getBoundingBox() const override;
     /// @brief Returns the centroid of the instance in world coordinates. 
@@ -121,6 +135,13 @@ public:
      * @param rng A random number generator used to steer sampling decisions.
      */
     AreaSample sampleArea(Sampler &rng) const override;
+    /**
+     * @brief Samples a point in world coordinates on the surface of this instance, as seen from @c origin (see
+     * @ref Shape::sampleArea ).
+     * @param origin The point to be illuminated in world coordinates.
+     * @param rng A random number generator used to steer sampling decisions.
+     */
+    AreaSample sampleArea(const Point &origin, Sampler &rng) const override;
 
     /// @brief Returns a textual representation of this image.
     std::string toString() const override {
@@ -11,9 +11,12 @@
 #include <lightwave/sampler.hpp>
 #include <lightwave/image.hpp>
 #include <lightwave/scene.hpp>
+#include <lightwave/camera.hpp>
 
 namespace lightwave {
 
+class Streaming;
+
 /**
  * @brief Integrators are rendering algorithms that take a scene and produce an image from them (e.g., using path tracing).
  * The term integrator refers to the key challenge of simulating light transport, namely solving the reflected radiance integral.
@@ -37,6 +40,67 @@ protected:
     ref<Image> m_image;
     /// @brief The scene that should be rendered.
     ref<Scene> m_scene;
+    /**
+     * @brief Side length (in pixels) of the square pixel packets that camera rays are traced in, or 1 to trace camera
+     * rays individually. Only used by integrators that support packet tracing (see @ref supportsPacketTracing ).
+     */
+    int m_packetSize;
+
+    /// @brief Whether pixels stop receiving samples once their estimate has converged (see @ref renderAdaptive ).
+    bool m_adaptive;
+    /// @brief The relative standard error of the pixel luminance below which a pixel is considered converged.
+    float m_adaptiveThreshold;
+    /// @brief The number of samples each pixel receives before convergence is tested for the first time.
+    int m_adaptiveMinSamples;
+    /// @brief The maximum number of samples a single pixel can receive in adaptive mode.
+    int m_adaptiveMaxSamples;
+    /// @brief Whether the image is rendered in passes of @ref m_samplesPerPass samples, and updated after each of them.
+    bool m_progressive;
+    /// @brief The number of samples each pixel receives per pass in progressive mode.
+    int m_samplesPerPass;
+    /// @brief Wall-clock time (in seconds) after which progressive or adaptive rendering stops, or 0 for no limit.
+    float m_timeLimit;
+    /**
+     * @brief Interval (in seconds) at which the state of a progressive render is written to a checkpoint file next to
+     * the output image, or 0 to disable checkpoints. Renders resume from their checkpoint when started with --resume .
+     */
+    float m_checkpointInterval;
+    /// @brief An optional image that receives the number of samples that have been taken for each pixel.
+    ref<Image> m_sampleCountImage;
+
+    /// @brief The running estimate of a pixel when rendering in passes.
+    struct PixelEstimate {
+        /// @brief The sum of all samples taken so far.
+        Color sum;
+        /// @brief The number of samples taken so far (which is also the index of the next sample).
+        int count = 0;
+        /// @brief The mean luminance of all samples taken so far.
+        float mean = 0;
+        /// @brief The sum of squared deviations from the mean luminance (see Welford's algorithm).
+        float m2 = 0;
+        /// @brief Whether the pixel no longer receives samples.
+        bool converged = false;
+    };
+
+    /// @brief Renders a block of pixels by tracing coherent packets of camera rays (used when packet tracing is enabled).
+    void renderPacketBlock(const Bounds2i &block);
+    /**
+     * @brief Renders the image in passes, each of which adds samples to all pixels that have not finished yet, until
+     * either all pixels have received their samples or the time limit is reached. In adaptive mode, pixels whose
+     * estimate has converged are excluded from further passes, and the samples saved this way are spent on the
+     * remaining (noisy) pixels, so that on average each pixel still receives the sample count of the sampler.
+     */
+    void renderProgressive(Streaming &stream);
+    /**
+     * @brief Renders only the blocks and sample indices selected on the command line (see @ref Options ), and saves
+     * the unnormalized sum of samples along with the number of samples of each pixel (as weight channel "W") to a
+     * partial image, which can be combined with the partial images of other workers by the merge tool.
+     */
+    void renderPartial(Streaming &stream);
+    /// @brief Writes the state of a progressive render to the checkpoint file next to the output image.
+    void saveCheckpoint(const std::vector<PixelEstimate> &estimates, int passes) const;
+    /// @brief Restores the state of a progressive render from its checkpoint file, returning false if none exists.
+    bool loadCheckpoint(std::vector<PixelEstimate> &estimates, int &passes) const;
 
 public:
     SamplingIntegrator(const Properties &properties)
@@ -44,6 +108,29 @@ public:
         m_sampler = properties.getChild<Sampler>();
         m_image = properties.getOptionalChild<Image>();
         m_scene = properties.getChild<Scene>();
+        if (m_scene->camera()) m_sampler->setResolution(m_scene->camera()->resolution());
+        m_packetSize = properties.get<int>("packetSize", 1);
+        if (m_packetSize < 1 || m_packetSize * m_packetSize > RayPacket::MaxSize) {
+            lightwave_throw("packetSize must lie between 1 and 8, but is %d", m_packetSize);
+        }
+
+        const int spp = m_sampler->samplesPerPixel();
+        m_adaptive = properties.get<bool>("adaptive", false);
+        m_adaptiveThreshold = properties.get<float>("adaptiveThreshold", 0.02f);
+        m_adaptiveMinSamples = properties.get<int>("adaptiveMinSamples", std::max(2, spp / 8));
+        m_adaptiveMaxSamples = properties.get<int>("adaptiveMaxSamples", 4 * spp);
+        if (m_adaptiveMinSamples < 1 || m_adaptiveMaxSamples < m_adaptiveMinSamples) {
+            lightwave_throw("adaptive sampling requires 1 <= adaptiveMinSamples <= adaptiveMaxSamples");
+        }
+        m_progressive = properties.get<bool>("progressive",
+            properties.has("timeLimit") || properties.has("checkpointInterval"));
+        m_samplesPerPass = properties.get<int>("samplesPerPass", 1);
+        m_timeLimit = properties.get<float>("timeLimit", 0);
+        m_checkpointInterval = properties.get<float>("checkpointInterval", 0);
+        if (m_samplesPerPass < 1) {
+            lightwave_throw("samplesPerPass must be at least 1");
+        }
+        m_sampleCountImage = properties.get<Image>("sampleCount", nullptr);
     }
 
     /// @brief Sets the output image that should be populated by rendering.
@@ -66,6 +153,17 @@ public:
      * @ref execute function of the integrator.
      */
     virtual Color Li(const Ray &ray, Sampler &rng) = 0;
+
+    /**
+     * @brief Returns (an estimate of) the incident radiance for a camera ray whose closest intersection @c its has
+     * already been found, e.g., by tracing a packet of camera rays. By default, @c its is ignored and @ref Li is invoked.
+     */
+    virtual Color Li(const Ray &ray, const Intersection &its, Sampler &rng) {
+        return Li(ray, rng);
+    }
+
+    /// @brief Reports whether this integrator benefits from tracing camera rays in packets (i.e., overrides the @ref Li variant taking an intersection).
+    virtual bool supportsPacketTracing() const { return false; }
 };
 
 }
@@ -8,9 +8,56 @@
 #include <lightwave/core.hpp>
 #include <lightwave/color.hpp>
 #include <lightwave/math.hpp>
+#include <lightwave/warp.hpp>
+
+#include <optional>
 
 namespace lightwave {
 
+/// @brief The result of sampling a ray leaving a light source using @ref Light::sampleEmission .
+struct EmissionSample {
+    /// @brief The ray leaving the light source.
+    Ray ray;
+    /// @brief The power carried along the ray, given by @code Le * cos / p(position, direction) @endcode
+    Color weight;
+    /// @brief The surface normal at the origin of the ray, or zero for lights without a surface (e.g., point lights).
+    Vector normal = Vector(0);
+
+    /// @brief Return an invalid sample, used to denote that sampling has failed.
+    static EmissionSample invalid() {
+        return {
+            .ray = Ray(),
+            .weight = Color(),
+        };
+    }
+
+    /// @brief Tests whether the sample is invalid (i.e., sampling has failed).
+    bool isInvalid() const {
+        return weight == Color(0);
+    }
+};
+
+/// @brief The densities of sampling a ray leaving a light source, as returned by @ref Light::pdfEmission .
+struct EmissionPdf {
+    /// @brief The density of the origin of the ray, in area units.
+    float position;
+    /// @brief The density of the direction of the ray, in solid angle units.
+    float direction;
+};
+
+/**
+ * @brief Starts a ray travelling along @c direction on a disk that covers the whole scene, which lets lights that are
+ * infinitely far away emit rays into the scene. @c area receives the area of the disk (on which the origin is uniform).
+ */
+inline Ray sampleSceneDisk(const Bounds &sceneBounds, const Vector &direction, const Point2 &rnd, float &area) {
+    const Point center = sceneBounds.center();
+    const float radius = std::max(sceneBounds.diagonal().length() / 2, Epsilon);
+    const Frame frame(direction);
+    const Point2 disk = squareToUniformDiskConcentric(rnd);
+    area = Pi * sqr(radius);
+    return Ray(center + radius * (frame.tangent * disk.x() + frame.bitangent * disk.y() - direction), direction);
+}
+
 /// @brief The result of sampling a light from a given query point using @ref Light::sampleDirect .
 struct DirectLightSample {
     /// @brief The direction vector, pointing from the query point towards the light.
@@ -19,6 +66,16 @@ struct DirectLightSample {
     Color weight;
     /// @brief The distance from the query point to the sampled point on the light source.
     float distance;
+    /**
+     * @brief The solid angle density of having sampled @c wi , used for multiple importance sampling.
+     * Lights that can only be connected to deterministically (e.g., point lights) report @c Infinity .
+     */
+    float pdf;
+    /**
+     * @brief The surface normal at the sampled point on the light, which allows to connect other query points to the
+     * same point (e.g., for reservoir resampling). Lights without a surface (e.g., point lights) leave this at zero.
+     */
+    Vector normal = Vector(0);
 
     /// @brief Return an invalid sample, used to denote that sampling has failed.
     static DirectLightSample invalid() {
@@ -26,6 +83,7 @@ struct DirectLightSample {
             .wi = Vector(),
             .weight = Color(),
             .distance = 0,
+            .pdf = 0,
         };
     }
 
@@ -35,6 +93,35 @@ struct DirectLightSample {
     }
 };
 
+/**
+ * @brief Conservatively bounds where a light source (or a cluster of light sources) emits, and in which directions.
+ * Used to build light hierarchies, which pick lights in proportion to their estimated contribution at a shading point.
+ * @note Directions are bounded as in "Importance Sampling of Many Lights with Adaptive Tree Splitting" [Conty Estevez
+ * and Kulla 2018]: all surface normals lie within a cone around @c axis (with spread @c cosThetaO ), and light leaves
+ * each surface within a further angle @c cosThetaE around its normal (e.g., 90 degrees for lambertian emitters).
+ */
+struct LightBounds {
+    /// @brief The region of space the emitting points lie in.
+    Bounds bounds;
+    /// @brief An estimate of the emitted power (as luminance), e.g., the intensity of a point light times 4 pi.
+    float power = 0;
+    /// @brief The axis of the cone of surface normals.
+    Vector axis = Vector(0, 0, 1);
+    /// @brief The cosine of the spread of the cone of surface normals (-1 for emitters facing all directions).
+    float cosThetaO = 1;
+    /// @brief The cosine of the angle around each surface normal that light is emitted into.
+    float cosThetaE = 1;
+
+    /// @brief Extends the bounds to also cover another light (the powers are summed up).
+    void extend(const LightBounds &other);
+    /**
+     * @brief Estimates the contribution of the bounded lights to a given shading point, i.e., their power over the squared
+     * distance, reduced by the cosine of the smallest possible angle between emitted directions and the shading point.
+     * @note Returns zero only if none of the bounded lights can illuminate the point.
+     */
+    float importance(const Point &origin) const;
+};
+
 /**
  * @brief A light source that can be sampled for direct connections.
  * Some light sources can also be intersected by rays (e.g., area lights or the background light),
@@ -49,8 +136,43 @@ public:
      */
     virtual DirectLightSample sampleDirect(const Point &origin, Sampler &rng) const = 0;
 
+    /**
+     * @brief Returns the solid angle density with which @ref sampleDirect would have picked the point a ray from
+     * @c origin has hit on this light source, used to weight hits found by bsdf sampling against light sampling.
+     * @note Only meaningful for lights that can be intersected. For background lights, the ray has escaped the scene and
+     * only the direction @c its.wo (pointing back towards the origin) is relevant.
+     */
+    virtual float pdfDirect(const Point &origin, const Intersection &its) const { return 0; }
+
+    /**
+     * @brief Samples a ray leaving the light source, e.g., to trace photons from it. Lights that are infinitely far away
+     * start their rays on a disk that covers the scene as seen from the sampled direction.
+     * @note Lights that do not support this return an invalid sample.
+     * @param sceneBounds The bounds of the scene geometry.
+     * @param rng A random number generator used to steer the sampling.
+     */
+    virtual EmissionSample sampleEmission(const Bounds &sceneBounds, Sampler &rng) const {
+        return EmissionSample::invalid();
+    }
+
+    /**
+     * @brief Returns the densities with which @ref sampleEmission produces a ray leaving the point @c position (with
+     * surface normal @c normal ) in @c direction , as needed for multiple importance sampling of light paths.
+     * @note Lights that are positioned by a Dirac distribution (e.g., point lights) report a position density of one.
+     * Lights that are infinitely far away report zero for both densities.
+     */
+    virtual EmissionPdf pdfEmission(const Point &position, const Vector &normal, const Vector &direction) const {
+        return { 0, 0 };
+    }
+
     /// @brief Returns whether this light source can be hit by rays (i.e., has an area that has been placed within the scene).
     virtual bool canBeIntersected() const { return false; }
+
+    /**
+     * @brief Returns where and how strongly this light emits, used to place it within light hierarchies.
+     * Lights that are infinitely far away (e.g., directional or background lights) have no such bounds and return nothing.
+     */
+    virtual std::optional<LightBounds> lightBounds() const { return std::nullopt; }
 };
 
 /// @brief The result of evaluating a @ref BackgroundLight for a incident direction.
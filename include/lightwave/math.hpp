@@ -11,6 +11,8 @@
 #include <cmath>
 #include <algorithm>
 #include <array>
+#include <bit>
+#include <cstdint>
 #include <optional>
 
 namespace lightwave {
@@ -607,6 +609,14 @@ struct Ray {
     Vector direction;
     /// @brief The number of bounces encountered by the ray, for use in integrators.
     int depth = 0;
+    /**
+     * @brief The width of the cone of directions that the ray stands for (e.g., the pixel it was sampled in) at its
+     * origin, used to filter textures over the footprint of the ray ("ray cones" [Amanatides 1984]).
+     * Rays without a footprint (zero width and spread) look up textures at their finest resolution.
+     */
+    float width = 0;
+    /// @brief The angle by which the cone of the ray widens per unit distance (see @ref width ).
+    float spread = 0;
 
     Ray() {}
     Ray(Point origin, Vector direction, int depth = 0)
@@ -619,11 +629,14 @@ struct Ray {
 
     /// @brief Returns a copy of the ray with normalized direction vector (useful after applying transforms). 
     Ray normalized() const {
-        return Ray(
-            origin,
-            direction.normalized(),
-            depth
-        );
+        Ray result = *this;
+        result.direction = direction.normalized();
+        return result;
+    }
+
+    /// @brief Returns the width of the cone of the ray at a given distance @c t (see @ref width ).
+    float widthAt(float t) const {
+        return width + t * spread;
     }
 };
 
@@ -737,6 +750,11 @@ struct SurfaceEvent {
     float pdf;
     /// @brief The instance object associated with the surface.
     const Instance *instance = nullptr;
+    /**
+     * @brief How far the texture coordinates move per unit distance on the surface (averaged over all directions),
+     * which turns footprints on the surface into footprints in texture space. Zero if unknown.
+     */
+    float uvScale = 0;
 };
 
 /// @brief Describes an intersection of a ray with a surface.
@@ -745,6 +763,8 @@ struct Intersection : public SurfaceEvent {
     Vector wo;
     /// @brief The intersection distance, which can also be used to specify a maximum distance when querying intersections.
     float t;
+    /// @brief The width of the cone of the ray at the intersection (see @ref Ray::width ), set by @ref Scene::intersect .
+    float footprint = 0;
 
     /// @brief Statistics recorded while traversing acceleration structures.
     struct {
@@ -771,6 +791,110 @@ struct Intersection : public SurfaceEvent {
     BsdfSample sampleBsdf(Sampler &rng) const;
     /// @brief Evaluates the Bsdf of the underlying surface.
     BsdfEval evaluateBsdf(const Vector &wi) const;
+    /// @brief Returns the density of sampling @c wi from the Bsdf of the underlying surface (see @ref Bsdf::pdf ).
+    float pdfBsdf(const Vector &wi) const;
+    /// @brief Returns the albedo of the Bsdf of the underlying surface, or black if it has none.
+    Color albedoBsdf() const;
+    /// @brief Returns the texture values of the Bsdf of the underlying surface (see @ref Bsdf::prepare ).
+    const PreparedBsdf &preparedBsdf() const;
+    /**
+     * @brief Returns the width of the footprint of the ray in texture space, i.e., of the area the ray covers on the
+     * surface (which grows at grazing angles) measured in texture coordinates.
+     */
+    float uvFootprint() const;
+};
+
+/**
+ * @brief A bundle of coherent rays (e.g., camera rays of neighboring pixels) that are traced through the scene together.
+ * Besides the rays themselves, a packet keeps conservative interval bounds on the ray origins and reciprocal directions,
+ * which allows acceleration structures to cull entire subtrees for all rays of the packet with a single test.
+ * Rays are addressed through bit masks, where bit @c i set means that @code rays[i] @endcode is still active.
+ */
+struct RayPacket {
+    /// @brief The maximum number of rays in a packet (one bit per ray in a @ref Mask ).
+    static constexpr int MaxSize = 64;
+    /// @brief Bit mask used to mark which rays of a packet are active.
+    typedef uint64_t Mask;
+
+    /// @brief The rays of the packet.
+    std::array<Ray, MaxSize> rays;
+    /// @brief The random number generator associated with each ray (used, e.g., for alpha masking).
+    std::array<Sampler *, MaxSize> rng;
+    /// @brief The number of rays in the packet.
+    int size = 0;
+
+    /// @brief Lower bound of all ray origins.
+    Point originMin;
+    /// @brief Upper bound of all ray origins.
+    Point originMax;
+    /// @brief Lower bound of all reciprocal ray directions.
+    Vector invDirectionMin;
+    /// @brief Upper bound of all reciprocal ray directions.
+    Vector invDirectionMax;
+    /// @brief For each axis, +1 or -1 if all ray directions share that sign, or 0 if the packet is incoherent along that axis.
+    std::array<int, 3> directionSign;
+
+    /// @brief Returns a mask in which all rays of the packet are active.
+    Mask activeMask() const {
+        return size >= MaxSize ? ~Mask(0) : (Mask(1) << size) - 1;
+    }
+
+    /// @brief Updates the interval bounds to enclose all active rays of the given mask (call after modifying rays).
+    void computeBounds(Mask mask) {
+        originMin = Point(+Infinity);
+        originMax = Point(-Infinity);
+        invDirectionMin = Vector(+Infinity);
+        invDirectionMax = Vector(-Infinity);
+        directionSign = { 0, 0, 0 };
+        bool first = true;
+        for (Mask m = mask; m; m &= m - 1) {
+            const Ray &ray = rays[std::countr_zero(m)];
+            originMin = elementwiseMin(originMin, ray.origin);
+            originMax = elementwiseMax(originMax, ray.origin);
+            for (int dim = 0; dim < 3; dim++) {
+                const int sign = ray.direction[dim] > 0 ? +1 : (ray.direction[dim] < 0 ? -1 : 0);
+                if (first) directionSign[dim] = sign;
+                else if (directionSign[dim] != sign) directionSign[dim] = 0;
+
+                const float invDirection = 1 / ray.direction[dim];
+                invDirectionMin[dim] = std::min(invDirectionMin[dim], invDirection);
+                invDirectionMax[dim] = std::max(invDirectionMax[dim], invDirection);
+            }
+            first = false;
+        }
+    }
+
+    /**
+     * @brief Conservatively tests whether any ray of the packet could hit the given bounding box, using interval
+     * arithmetic on the packet bounds. Returning @c false guarantees that no ray of the packet hits the box.
+     */
+    bool mayIntersect(const Bounds &bounds) const {
+        float tNear = -Infinity;
+        float tFar  = +Infinity;
+        for (int dim = 0; dim < 3; dim++) {
+            // axes along which the directions disagree in sign do not constrain the interval
+            if (directionSign[dim] == 0) continue;
+
+            const bool positive = directionSign[dim] > 0;
+            const float nearSlab = positive ? bounds.min()[dim] : bounds.max()[dim];
+            const float farSlab  = positive ? bounds.max()[dim] : bounds.min()[dim];
+
+            // the slab distances (slab - origin) * invDirection span the products of both intervals
+            const float n0 = (nearSlab - originMin[dim]) * invDirectionMin[dim];
+            const float n1 = (nearSlab - originMin[dim]) * invDirectionMax[dim];
+            const float n2 = (nearSlab - originMax[dim]) * invDirectionMin[dim];
+            const float n3 = (nearSlab - originMax[dim]) * invDirectionMax[dim];
+            const float f0 = (farSlab - originMin[dim]) * invDirectionMin[dim];
+            const float f1 = (farSlab - originMin[dim]) * invDirectionMax[dim];
+            const float f2 = (farSlab - originMax[dim]) * invDirectionMin[dim];
+            const float f3 = (farSlab - originMax[dim]) * invDirectionMax[dim];
+
+            tNear = std::max(tNear, std::min({ n0, n1, n2, n3 }));
+            tFar  = std::min(tFar, std::max({ f0, f1, f2, f3 }));
+        }
+        // written with negations so that NaNs (e.g., from unbounded boxes) never cause a box to be culled
+        return !(tFar < tNear) && !(tFar < Epsilon);
+    }
 };
 
 /// @brief Print a given point to an output stream.
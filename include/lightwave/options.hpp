@@ -0,0 +1,36 @@
+/**
+ * @file options.hpp
+ * @brief Contains the options that can be passed to lightwave on the command line.
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+
+namespace lightwave {
+
+/// @brief Options passed to lightwave on the command line, which apply to all objects of the scene.
+struct Options {
+    /// @brief Whether renders should continue from their last checkpoint (if one exists) instead of starting over.
+    bool resume = false;
+
+    /// @brief Index of the worker (in [0, tileCount)) when the blocks of the image are distributed over several processes.
+    int tileIndex = 0;
+    /// @brief The number of workers the blocks of the image are distributed over.
+    int tileCount = 1;
+    /// @brief The first sample index to render for each pixel.
+    int sampleBegin = 0;
+    /// @brief One past the last sample index to render for each pixel, or -1 to render up to the sample count of the sampler.
+    int sampleEnd = -1;
+
+    /**
+     * @brief Reports whether only a part of the image (a subset of blocks or samples) should be rendered, in which case
+     * integrators write partial images that can be combined with the merge tool.
+     */
+    bool isPartialRender() const { return tileCount > 1 || sampleBegin > 0 || sampleEnd >= 0; }
+};
+
+/// @brief The options lightwave has been started with.
+extern Options options;
+
+}
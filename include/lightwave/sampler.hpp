@@ -22,7 +22,6 @@ class Sampler : public Object {
 protected:
     /// @brief The number of samples that should be taken per pixel.
     int m_samplesPerPixel;
-    // Point2i m_screenResolution;
 
 public:
     Sampler() : m_samplesPerPixel(0) {}
@@ -55,13 +54,11 @@ public:
     /// @brief Returns the number of samples that should be taken per pixel. 
     int samplesPerPixel() const { return m_samplesPerPixel; }
 
-    // void setScreenResolution(Point2i screenResolution) {
-    //     m_screenResolution = screenResolution;
-    // }
-
-    // Point2i getScreenResolution() {
-    //     return m_screenResolution;
-    // }
+    /**
+     * @brief Informs the sampler about the resolution of the image, which bounds the pixels it will be seeded with.
+     * Samplers that enumerate the pixels (e.g., along a space filling curve) use this to size their sequences.
+     */
+    virtual void setResolution(const Vector2i &resolution) {}
 };
 
 }
@@ -6,6 +6,8 @@
 #pragma once
 
 #include <lightwave/core.hpp>
+#include <lightwave/distribution.hpp>
+#include <unordered_map>
 #include <vector>
 
 namespace lightwave {
@@ -18,6 +20,8 @@ struct LightSample {
     float probability;
 };
 
+class LightHierarchy;
+
 /// @brief Scenes are the input to rendering algorithms: They contain all geometry, materials, lights and the camera.
 class Scene : public Object {
     /// @brief The camera from which the image is to be rendered.
@@ -32,6 +36,35 @@ class Scene : public Object {
      */
     std::vector<ref<Light>> m_lights;
 
+    /// @brief The strategies to pick lights for next event estimation with.
+    enum class LightSampling {
+        /// @brief All lights are equally likely.
+        Uniform,
+        /// @brief Lights are picked in proportion to their power.
+        Power,
+        /// @brief Lights are picked in proportion to their estimated contribution, using a @ref LightHierarchy .
+        Hierarchy,
+    };
+    /// @brief The strategy used by @ref sampleLight .
+    LightSampling m_lightSampling;
+    /**
+     * @brief Lights without finite bounds (e.g., directional or background lights), which are picked uniformly with a
+     * probability proportional to their count (counting all other lights as a single one).
+     * @note Only used for the power and hierarchy strategies.
+     */
+    std::vector<const Light *> m_infiniteLights;
+    /// @brief Lights with finite bounds, indexed like the entries of @ref m_lightPower .
+    std::vector<const Light *> m_boundedLights;
+    /// @brief The position of each light within @ref m_boundedLights .
+    std::unordered_map<const Light *, int> m_boundedLightIndex;
+    /// @brief Picks lights with finite bounds in proportion to their power.
+    AliasTable m_lightPower;
+    /// @brief Picks lights with finite bounds in proportion to their estimated contribution to a shading point.
+    ref<LightHierarchy> m_lightHierarchy;
+
+    /// @brief Returns the probability of picking any of the lights without finite bounds.
+    float infiniteLightProbability() const;
+
 public:
     Scene(const Properties &properties);
     std::string toString() const override;
@@ -41,6 +74,8 @@ public:
     
     /// @brief Finds the closest intersection of the scene for a given ray.
     Intersection intersect(const Ray &ray, Sampler &rng) const;
+    /// @brief Finds the closest intersection of the scene for each ray of a packet (@c its is indexed like the rays of the packet).
+    void intersect(const RayPacket &packet, Intersection *its) const;
     /// @brief Reports whether any intersection up to a given maximal distance exists (used for testing visibility of light sources).
     bool intersect(const Ray &ray, float tMax, Sampler &rng) const;
     /// @brief Evaluates the background illumination for a given direction pointing away from the scene.
@@ -48,12 +83,16 @@ public:
 
     /// @brief Reports whether at least one light exists that could be sampled.
     bool hasLights() const { return !m_lights.empty(); }
+    /// @brief Returns all lights that can be sampled (including the background light, if it can be sampled).
+    const std::vector<ref<Light>> &lights() const { return m_lights; }
     /// @brief Reports whether a background light exists. 
     bool hasBackground() const { return m_background != nullptr; }
-    /// @brief Randomly picks a light from the list of sampleable light sources. 
-    LightSample sampleLight(Sampler &rng) const;
-    /// @brief Returns the probability of randomly picking a light source via @ref sampleLight .
-    float lightSelectionProbability(const Light *light) const;
+    /// @brief Returns the background light (or null if the scene has none).
+    const BackgroundLight *background() const { return m_background.get(); }
+    /// @brief Randomly picks a light from the list of sampleable light sources to illuminate the given shading point. 
+    LightSample sampleLight(const Point &origin, Sampler &rng) const;
+    /// @brief Returns the probability of randomly picking a light source via @ref sampleLight for the given shading point.
+    float lightSelectionProbability(const Light *light, const Point &origin) const;
     /// @brief Returns the bounding box of the scene geometry.
     Bounds getBoundingBox() const;
 };
@@ -35,6 +35,21 @@ public:
      * @note Intersections farther away than the previous value of @c its.t will be dismissed.
      */
     virtual bool intersect(const Ray &ray, Intersection &its, Sampler &rng) const = 0;
+    /**
+     * @brief Tests the shape for intersection with all active rays of a packet, updating the corresponding entries of
+     * @c its (which is indexed like the rays of the packet). Returns the mask of rays for which an intersection was found.
+     * @note The default implementation falls back to intersecting the rays one by one. Shapes that can exploit the
+     * coherence of packets (e.g., acceleration structures) override this.
+     */
+    virtual RayPacket::Mask intersectPacket(const RayPacket &packet, RayPacket::Mask mask, Intersection *its) const {
+        RayPacket::Mask hits = 0;
+        for (RayPacket::Mask m = mask; m; m &= m - 1) {
+            const int i = std::countr_zero(m);
+            if (intersect(packet.rays[i], its[i], *packet.rng[i]))
+                hits |= RayPacket::Mask(1) << i;
+        }
+        return hits;
+    }
     /// @brief Returns a bounding box that tightly encapsulates the shape. 
     virtual Bounds getBoundingBox() const = 0;
     /**
@@ -48,6 +63,16 @@ public:
     virtual AreaSample sampleArea(Sampler &rng) const {
         NOT_IMPLEMENTED
     }
+    /**
+     * @brief Samples a random point on the surface of this shape for illuminating the given @c origin , ideally
+     * in proportion to the solid angle the shape covers as seen from there. The pdf is still reported with respect to area.
+     * @note Shapes that override this must report the same density in @ref intersect (as seen from the origin of the
+     * ray), so that lights can evaluate the density of points found by ray tracing. The default falls back to
+     * sampling the area uniformly.
+     */
+    virtual AreaSample sampleArea(const Point &origin, Sampler &rng) const {
+        return sampleArea(rng);
+    }
 
     /**
      * @brief Marks that the shape is part of the scene geometry, i.e., can be hit through @ref Scene::intersect .
@@ -55,6 +80,13 @@ public:
      * using a reference.
      */
     virtual void markAsVisible() {}
+    /**
+     * @brief Marks that the shape is sampled by an area light, i.e., intersections need to report the density of
+     * @ref sampleArea .
+     * @note Only needed by shapes whose intersections would otherwise lack parts of that density (e.g., groups, which
+     * randomly pick one of their children to sample).
+     */
+    virtual void markAsLightSource() {}
 };
 
 }
@@ -9,6 +9,8 @@
 #include <lightwave/math.hpp>
 #include <lightwave/color.hpp>
 
+#include <optional>
+
 namespace lightwave {
 
 /// @brief Models spatially varying material properties (e.g., images or procedural noise).
@@ -31,6 +33,14 @@ public:
         return evaluate(uv).r();
     }
 
+    /**
+     * @brief Returns the average color over a footprint of the given width (in texture coordinates) around @c uv ,
+     * which avoids aliasing when a ray covers many texels. Textures without prefiltered data ignore the footprint.
+     */
+    virtual Color evaluateFiltered(const Point2 &uv, float footprint) const {
+        return evaluate(uv);
+    }
+
     virtual float scalar_g(const Point2 &uv) const {
         return evaluate(uv).g();
     }
@@ -38,6 +48,78 @@ public:
     virtual float scalar_b(const Point2 &uv) const {
         return evaluate(uv).b();
     }
+
+    /**
+     * @brief Returns the resolution of the data underlying the texture (e.g., the pixels of an image), or zero for
+     * procedural textures. Used to tabulate sampling distributions (e.g., of environment maps) at a matching resolution.
+     */
+    virtual Point2i resolution() const {
+        return Point2i(0);
+    }
+
+    /// @brief Returns the value of the texture if it is the same everywhere, which allows skipping the texture lookup.
+    virtual std::optional<Color> constant() const {
+        return std::nullopt;
+    }
+};
+
+/**
+ * @brief A reference to a texture that materials hold instead of a plain @c ref<Texture> . Constant textures (the
+ * vast majority in practice) are stored inline, so that looking them up is an inlined load behind a well predicted
+ * branch instead of a virtual call. All other textures are dispatched through the @ref Texture interface.
+ */
+class TextureHandle {
+    ref<Texture> m_texture;
+    bool m_isConstant = false;
+    Color m_constant;
+
+public:
+    TextureHandle() = default;
+    TextureHandle(ref<Texture> texture) : m_texture(std::move(texture)) {
+        if (m_texture) {
+            if (const auto value = m_texture->constant()) {
+                m_isConstant = true;
+                m_constant = *value;
+            }
+        }
+    }
+
+    /// @brief Whether a texture is referenced (optional texture parameters may be missing).
+    explicit operator bool() const { return bool(m_texture); }
+    /// @brief The referenced texture (e.g., to query its resolution).
+    const ref<Texture> &texture() const { return m_texture; }
+
+    Color evaluate(const Point2 &uv) const {
+        return m_isConstant ? m_constant : m_texture->evaluate(uv);
+    }
+    float scalar(const Point2 &uv) const {
+        return m_isConstant ? m_constant.r() : m_texture->scalar(uv);
+    }
+    float scalar_g(const Point2 &uv) const {
+        return m_isConstant ? m_constant.g() : m_texture->scalar_g(uv);
+    }
+    float scalar_b(const Point2 &uv) const {
+        return m_isConstant ? m_constant.b() : m_texture->scalar_b(uv);
+    }
+
+    /// @brief Filtered variant of @ref evaluate (see @ref Texture::evaluateFiltered ).
+    Color evaluate(const Point2 &uv, float footprint) const {
+        return m_isConstant ? m_constant : m_texture->evaluateFiltered(uv, footprint);
+    }
+    /// @brief Filtered variant of @ref scalar (see @ref Texture::evaluateFiltered ).
+    float scalar(const Point2 &uv, float footprint) const {
+        return m_isConstant ? m_constant.r() : m_texture->evaluateFiltered(uv, footprint).r();
+    }
+    float scalar_g(const Point2 &uv, float footprint) const {
+        return m_isConstant ? m_constant.g() : m_texture->evaluateFiltered(uv, footprint).g();
+    }
+    float scalar_b(const Point2 &uv, float footprint) const {
+        return m_isConstant ? m_constant.b() : m_texture->evaluateFiltered(uv, footprint).b();
+    }
+
+    friend std::ostream &operator<<(std::ostream &stream, const TextureHandle &handle) {
+        return stream << handle.m_texture.get();
+    }
 };
 
 }
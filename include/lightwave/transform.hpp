@@ -159,9 +159,10 @@ public:
         
         m_transform = matrix * m_transform;
 
+        // the inverse rotates by the transpose, after undoing the translation (which thus needs to be rotated as well)
         matrix.setColumn(3, Vector4(0, 0, 0, 1));
         matrix = matrix.transpose();
-        matrix.setColumn(3, Vector4(-origin, 1));
+        matrix.setColumn(3, Vector4(-left.dot(origin), -orthogonalUp.dot(origin), -direction.dot(origin), 1));
 
         m_inverse = m_inverse * matrix;
     }
@@ -79,4 +79,13 @@ inline float cosineHemispherePdf(const Vector &vector) {
     return InvPi * std::max(vector.z(), float(0));
 }
 
+/**
+ * @brief Warps a given point from the unit square ([0,0] to [1,1]) to barycentric coordinates that are uniformly
+ * distributed over a triangle (i.e., the returned coordinates lie within [0,0], [1,0] and [0,1]).
+ */
+inline Vector2 squareToUniformTriangle(const Point2 &sample) {
+    const float su = std::sqrt(sample.x());
+    return { 1 - su, sample.y() * su };
+}
+
 }
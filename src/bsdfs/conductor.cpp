@@ -3,7 +3,7 @@
 namespace lightwave {
 
 class Conductor : public Bsdf {
-    ref<Texture> m_reflectance;
+    TextureHandle m_reflectance;
 
 public:
     Conductor(const Properties &properties) {
@@ -18,12 +18,19 @@ public:
         return BsdfEval::invalid();
     }
 
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        // for the same reason, light sampling never needs to be weighted
+        // against this bsdf
+        return 0;
+    }
+
     BsdfSample sample(const Point2 &uv, const Vector &wo,
                       Sampler &rng) const override {
         // NOT_IMPLEMENTED
         return BsdfSample{
             .wi = reflect(wo, Vector(0, 0, 1)).normalized(),
-            .weight = m_reflectance->evaluate(uv) ,
+            .weight = m_reflectance.evaluate(uv) ,
         };
         
     }
@@ -32,6 +39,20 @@ public:
         return Color::black();
     }
 
+    void prepare(PreparedBsdf &prepared) const override {
+        prepared.color = m_reflectance.evaluate(prepared.uv, prepared.footprint);
+    }
+
+    BsdfSample samplePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              Sampler &rng) const override {
+        return BsdfSample{
+            .wi     = reflect(wo, Vector(0, 0, 1)).normalized(),
+            .weight = prepared.color,
+        };
+    }
+
+    bool isSpecular() const override { return true; }
+
     std::string toString() const override {
         return tfm::format("Conductor[\n"
                            "  reflectance = %s\n"
@@ -4,9 +4,9 @@
 namespace lightwave {
 
 class Dielectric : public Bsdf {
-    ref<Texture> m_ior;
-    ref<Texture> m_reflectance;
-    ref<Texture> m_transmittance;
+    TextureHandle m_ior;
+    TextureHandle m_reflectance;
+    TextureHandle m_transmittance;
 
 public:
     Dielectric(const Properties &properties) {
@@ -23,12 +23,19 @@ public:
         return BsdfEval::invalid();
     }
 
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        // for the same reason, light sampling never needs to be weighted
+        // against this bsdf
+        return 0;
+    }
+
     BsdfSample sample(const Point2 &uv, const Vector &wo,
                       Sampler &rng) const override {
         
         if (wo.z()==0.f)  return BsdfSample::invalid();
 
-        float  ior        = m_ior->scalar(uv);// ior = in/ext
+        float  ior        = m_ior.scalar(uv);// ior = in/ext
         float  eta        = ior;
         Vector normal     = Vector(0.f, 0.f, 1.f);
 
@@ -46,13 +53,13 @@ public:
         if (rng.next() < Fr) // reflect
                           return BsdfSample{
                                 .wi       = reflect_wi,
-                                .weight   = m_reflectance->evaluate(uv) 
+                                .weight   = m_reflectance.evaluate(uv) 
                           };
             
         else // refract
                           return BsdfSample{
                                 .wi       = refract(wo, normal, eta).normalized(),
-                                .weight   = m_transmittance->evaluate(uv) * sqr(1/eta)  
+                                .weight   = m_transmittance.evaluate(uv) * sqr(1/eta)  
                           };        
         
     }
@@ -61,6 +68,7 @@ public:
         return Color::black();
     }
 
+    bool isSpecular() const override { return true; }
 
     std::string toString() const override {
         return tfm::format("Dielectric[\n"
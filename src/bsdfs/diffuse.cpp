@@ -3,7 +3,7 @@
 namespace lightwave {
 
 class Diffuse : public Bsdf {
-    ref<Texture> m_albedo;
+    TextureHandle m_albedo;
 
 public:
     Diffuse(const Properties &properties) {
@@ -21,11 +21,16 @@ public:
         if(Frame::cosTheta(wi) <= 0.f) return BsdfEval::invalid();
        
         return BsdfEval{
-            .value = m_albedo->evaluate(uv) * InvPi * Frame::cosTheta(wi)
+            .value = m_albedo.evaluate(uv) * InvPi * Frame::cosTheta(wi)
             };
           
     }
 
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        return cosineHemispherePdf(wi);
+    }
+
     BsdfSample sample(const Point2 &uv, const Vector &wo,
                       Sampler &rng) const override {
         
@@ -35,20 +40,48 @@ public:
             return BsdfSample::invalid();
         return BsdfSample{
             .wi     = wi,
-            .weight = m_albedo->evaluate(uv),
+            .weight = m_albedo.evaluate(uv),
         };
     }
 
     Color albedo(const Point2 &uv) const override {
         // return m_albedo->evaluate(uv);
-        if(m_albedo != nullptr){
-            return m_albedo->evaluate(uv);
+        if (m_albedo) {
+            return m_albedo.evaluate(uv);
         } else {
             return Color::black();
         }
     }
     
 
+    void prepare(PreparedBsdf &prepared) const override {
+        if (m_albedo) prepared.color = m_albedo.evaluate(prepared.uv, prepared.footprint);
+    }
+
+    BsdfEval evaluatePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              const Vector &wi) const override {
+        if (Frame::cosTheta(wi) <= 0.f) return BsdfEval::invalid();
+        return BsdfEval{
+            .value = prepared.color * InvPi * Frame::cosTheta(wi),
+        };
+    }
+
+    BsdfSample samplePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              Sampler &rng) const override {
+        const Vector wi = squareToCosineHemisphere(rng.next2D()).normalized();
+        if (Frame::cosTheta(wi) <= 0.f) return BsdfSample::invalid();
+        return BsdfSample{
+            .wi     = wi,
+            .weight = prepared.color,
+        };
+    }
+
+    Color albedoPrepared(const PreparedBsdf &prepared) const override {
+        return prepared.color;
+    }
+
+    bool isDiffuse() const override { return true; }
+
     std::string toString() const override {
         return tfm::format("Diffuse[\n"
                            "  albedo = %s\n"
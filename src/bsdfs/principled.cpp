@@ -21,6 +21,10 @@ struct DiffuseLobe {
             };
     }
 
+    float pdf(const Vector &wo, const Vector &wi) const {
+        return cosineHemispherePdf(wi);
+    }
+
     BsdfSample sample(const Vector &wo, Sampler &rng) const {
         // hints:
         // * copy your diffuse bsdf evaluate here
@@ -71,6 +75,13 @@ struct MetallicLobe {
         return {.value=(color*D*G_wi*G_wo)/(4.f*cos_theta_o)};
     }
 
+    float pdf(const Vector &wo, const Vector &wi) const {
+        if (Frame::cosTheta(wi) <= 0) return 0;
+        const Vector wh = (wo + wi).normalized();
+        return lightwave::microfacet::pdfGGXVNDF(alpha, wh, wo) *
+               lightwave::microfacet::detReflection(wh, wo);
+    }
+
     BsdfSample sample(const Vector &wo, Sampler &rng) const {
         // hints:
         // * copy your roughconductor bsdf sample here
@@ -101,10 +112,10 @@ struct MetallicLobe {
 };
 
 class Principled : public Bsdf {
-    ref<Texture> m_baseColor;
-    ref<Texture> m_roughness;
-    ref<Texture> m_metallic;
-    ref<Texture> m_specular;
+    TextureHandle m_baseColor;
+    TextureHandle m_roughness;
+    TextureHandle m_metallic;
+    TextureHandle m_specular;
     bool isorm;
 
     struct Combination {
@@ -113,12 +124,11 @@ class Principled : public Bsdf {
         MetallicLobe metallic;
     };
 
-    Combination combine(const Point2 &uv, const Vector &wo) const {
-        const auto baseColor = m_baseColor->evaluate(uv);
-        const auto alpha = std::max(float(1e-3), sqr(m_roughness->scalar(uv)));
-        const auto specular = !isorm? m_specular->scalar(uv) : m_specular->scalar_g(uv);
-        const auto metallic = !isorm? m_metallic->scalar(uv) : m_metallic->scalar_b(uv);
-
+    Combination combine(const PreparedBsdf &prepared, const Vector &wo) const {
+        const auto baseColor = prepared.color;
+        const auto alpha = std::max(float(1e-3), sqr(prepared.scalars[0]));
+        const auto specular = prepared.scalars[1];
+        const auto metallic = prepared.scalars[2];
 
         const auto F =
             specular * schlick((1 - metallic) * 0.08f, Frame::cosTheta(wo));
@@ -151,9 +161,33 @@ public:
         m_specular  = properties.get<Texture>("specular");
     }
 
+    void prepare(PreparedBsdf &prepared) const override {
+        const Point2 &uv = prepared.uv;
+        const float footprint = prepared.footprint;
+        prepared.color      = m_baseColor.evaluate(uv, footprint);
+        prepared.scalars[0] = m_roughness.scalar(uv, footprint);
+        prepared.scalars[1] = !isorm? m_specular.scalar(uv, footprint) : m_specular.scalar_g(uv, footprint);
+        prepared.scalars[2] = !isorm? m_metallic.scalar(uv, footprint) : m_metallic.scalar_b(uv, footprint);
+    }
+
     BsdfEval evaluate(const Point2 &uv, const Vector &wo,
                       const Vector &wi) const override {
-        const auto combination = combine(uv, wo);
+        return evaluatePrepared(prepareAt(uv), wo, wi);
+    }
+
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        return pdfPrepared(prepareAt(uv), wo, wi);
+    }
+
+    BsdfSample sample(const Point2 &uv, const Vector &wo,
+                      Sampler &rng) const override {
+        return samplePrepared(prepareAt(uv), wo, rng);
+    }
+
+    BsdfEval evaluatePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              const Vector &wi) const override {
+        const auto combination = combine(prepared, wo);
         auto comb_diff = combination.diffuse.evaluate(wo, wi);
         auto comb_mett = combination.metallic.evaluate(wo, wi);
         // assert(std::isnan(comb_diff.value.r()) == false);
@@ -167,9 +201,17 @@ public:
         // combine their results
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
-                      Sampler &rng) const override {
-        const auto combination = combine(uv, wo);
+    float pdfPrepared(const PreparedBsdf &prepared, const Vector &wo,
+                      const Vector &wi) const override {
+        // mixture of both lobes, weighted by the probability of selecting them in `sample`
+        const auto combination = combine(prepared, wo);
+        return combination.diffuseSelectionProb * combination.diffuse.pdf(wo, wi) +
+               (1 - combination.diffuseSelectionProb) * combination.metallic.pdf(wo, wi);
+    }
+
+    BsdfSample samplePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              Sampler &rng) const override {
+        const auto combination = combine(prepared, wo);
         // hint: sample either `combination.diffuse` (probability
         // `combination.diffuseSelectionProb`) or `combination.metallic`
 
@@ -188,13 +230,17 @@ public:
     
     Color albedo(const Point2 &uv) const override {
         // return m_baseColor->evaluate(uv);
-        if(m_baseColor != nullptr){
-            return m_baseColor->evaluate(uv);
+        if (m_baseColor) {
+            return m_baseColor.evaluate(uv);
         } else {
             return Color::black();
         }
     }
 
+    Color albedoPrepared(const PreparedBsdf &prepared) const override {
+        return prepared.color;
+    }
+
 
     std::string toString() const override {
         return tfm::format("Principled[\n"
@@ -5,8 +5,8 @@
 namespace lightwave {
 
 class RoughConductor : public Bsdf {
-    ref<Texture> m_reflectance;
-    ref<Texture> m_roughness;
+    TextureHandle m_reflectance;
+    TextureHandle m_roughness;
 
 public:
     RoughConductor(const Properties &properties) {
@@ -14,14 +14,34 @@ public:
         m_roughness   = properties.get<Texture>("roughness");
     }
 
-    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
-                      const Vector &wi) const override {
+    void prepare(PreparedBsdf &prepared) const override {
+        prepared.color      = m_reflectance.evaluate(prepared.uv, prepared.footprint);
         // Using the squared roughness parameter results in a more gradual
         // transition from specular to rough. For numerical stability, we avoid
         // extremely specular distributions (alpha values below 10^-3)
-        const auto alpha = std::max(float(1e-3), sqr(m_roughness->scalar(uv)));
+        prepared.scalars[0] = std::max(float(1e-3), sqr(m_roughness.scalar(prepared.uv, prepared.footprint)));
+    }
+
+    BsdfEval evaluate(const Point2 &uv, const Vector &wo,
+                      const Vector &wi) const override {
+        return evaluatePrepared(prepareAt(uv), wo, wi);
+    }
+
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        return pdfPrepared(prepareAt(uv), wo, wi);
+    }
+
+    BsdfSample sample(const Point2 &uv, const Vector &wo,
+                      Sampler &rng) const override {
+        return samplePrepared(prepareAt(uv), wo, rng);
+    }
 
-        Color R = m_reflectance->evaluate(uv);
+    BsdfEval evaluatePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              const Vector &wi) const override {
+        const auto alpha = prepared.scalars[0];
+
+        Color R = prepared.color;
         Vector wh = (wo + wi) / (wo + wi).length();
         float D = lightwave::microfacet::evaluateGGX(alpha, wh);
 
@@ -37,9 +57,20 @@ public:
         // * the microfacet normal can be computed from `wi' and `wo'
     }
 
-    BsdfSample sample(const Point2 &uv, const Vector &wo,
-                      Sampler &rng) const override {
-        const auto alpha = std::max(float(1e-3), sqr(m_roughness->scalar(uv)));
+    float pdfPrepared(const PreparedBsdf &prepared, const Vector &wo,
+                      const Vector &wi) const override {
+        const auto alpha = prepared.scalars[0];
+        if (Frame::cosTheta(wi) <= 0) return 0;
+
+        // density of the sampled microfacet normal, times the change of density of the reflection
+        const Vector wh = (wo + wi).normalized();
+        return lightwave::microfacet::pdfGGXVNDF(alpha, wh, wo) *
+               lightwave::microfacet::detReflection(wh, wo);
+    }
+
+    BsdfSample samplePrepared(const PreparedBsdf &prepared, const Vector &wo,
+                              Sampler &rng) const override {
+        const auto alpha = prepared.scalars[0];
 
         // sample microfacet normal
         Vector normal = lightwave::microfacet::sampleGGXVNDF(alpha, wo, rng.next2D());
@@ -59,7 +90,7 @@ public:
 
         float G_wi = lightwave::microfacet::smithG1(alpha, normal, wi);
 
-        Color weight = m_reflectance->evaluate(uv) * G_wi;
+        Color weight = prepared.color * G_wi;
 
         return BsdfSample{
             .wi=wi,
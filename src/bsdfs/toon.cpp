@@ -3,7 +3,7 @@
 namespace lightwave {
 
 class Toon : public Bsdf {
-    ref<Texture> m_albedo;
+    TextureHandle m_albedo;
 
 public:
     Toon(const Properties &properties) {
@@ -25,7 +25,7 @@ public:
                       const Vector &wi) const override {
         // compute how strongly the current hit reflects the light source
         if(Frame::cosTheta(wi) <= 0.f) return BsdfEval::invalid();
-        Color out = m_albedo->evaluate(uv) * InvPi * Frame::cosTheta(wi);
+        Color out = m_albedo.evaluate(uv) * InvPi * Frame::cosTheta(wi);
 
         out.r() = ramp(0.1f, 0.12f, out.r());
         out.g() = ramp(0.1f, 0.2f, out.g());
@@ -37,6 +37,11 @@ public:
           
     }
 
+    float pdf(const Point2 &uv, const Vector &wo,
+              const Vector &wi) const override {
+        return cosineHemispherePdf(wi);
+    }
+
     BsdfSample sample(const Point2 &uv, const Vector &wo,
                       Sampler &rng) const override {
         
@@ -46,7 +51,7 @@ public:
             return BsdfSample::invalid();
         return BsdfSample{
             .wi     = wi,
-            .weight = m_albedo->evaluate(uv),
+            .weight = m_albedo.evaluate(uv),
         };
     }
     
@@ -54,6 +59,8 @@ public:
         return Color::black();
     }
 
+    bool isDiffuse() const override { return true; }
+
     std::string toString() const override {
         return tfm::format("Toon[\n"
                            "  albedo = %s\n"
@@ -24,6 +24,8 @@ public:
         else {
             focal_length = (0.5f * m_resolution.y()) / (tan(fov * 0.5f));
         }
+        // pixels are one unit wide on the image plane at distance focal_length
+        m_pixelSpread = 1 / focal_length;
     }
 
     CameraSample sample(const Point2 &normalized, Sampler &rng) const override {
@@ -56,6 +58,34 @@ public:
                                         .weight = Color(1.0f)};
     }
 
+    CameraDirectSample sampleDirect(const Point &origin, Sampler &rng) const override {
+        const Point local = m_transform->inverse(origin);
+        if (!(local.z() > 0)) return CameraDirectSample::invalid();
+
+        // project onto the image plane at distance focal_length, where pixels are one unit wide
+        const float x = local.x() * focal_length / local.z() + 0.5f * m_resolution.x();
+        const float y = local.y() * focal_length / local.z() + 0.5f * m_resolution.y();
+        if (!(x >= 0 && y >= 0 && x < m_resolution.x() && y < m_resolution.y())) return CameraDirectSample::invalid();
+
+        Vector wi = m_transform->apply(Point(0)) - origin;
+        const float distance = wi.length();
+        wi /= distance;
+
+        // a pixel covers a solid angle of cos^3 / focal_length^2, and the importance is the inverse of that angle
+        // (turning radiance into the average over the pixel), converted to the area around the connected point
+        const float cosTheta = local.z() / Vector(local).length();
+        const float pixelDensity = sqr(focal_length) / (cosTheta * cosTheta * cosTheta);
+        return CameraDirectSample{
+            .pixel = Point2i(int(x), int(y)),
+            .wi = wi,
+            .distance = distance,
+            .weight = Color(pixelDensity / sqr(distance)),
+            .pdf = pixelDensity / m_resolution.product(),
+        };
+    }
+
+    bool supportsDirectSampling() const override { return true; }
+
     std::string toString() const override {
         return tfm::format(
             "Perspective[\n"
@@ -23,6 +23,8 @@ public:
         focal_length = (is_x * m_resolution.x() + (1-is_x) * m_resolution.y()) * 0.5f / (tan(fov * 0.5f));
         lens_radius = properties.get<float>("lensRadius", 0.05f);
         focal_distance = properties.get<float>("focalDistance", 7.f);
+        // the footprint of the lens itself is left to the samples, only the pixel footprint is filtered
+        m_pixelSpread = 1 / focal_length;
     }
 
     CameraSample sample(const Point2 &normalized, Sampler &rng) const override {
@@ -9,10 +9,13 @@ CameraSample Camera::sample(const Point2i &pixel, Sampler &rng) const {
     // normalize by image resolution to end up with value in range [-1,-1] to [+1,+1]
     const auto normalized = 2 * pixelPlusRandomOffset / m_resolution.cast<float>() - Vector2(1);
     // generate the sample using the normalized sample function
-    const auto s = sample(normalized, rng);
+    auto s = sample(normalized, rng);
     assert_normalized(s.ray.direction, {
         logger(EError, "your Camera::sample implementation returned a non-normalized direction");
     });
+    // the samples of a pixel already average over its area, so each of them only needs to cover its share of the
+    // pixel (down to an eighth of its width)
+    s.ray.spread = m_pixelSpread * std::max(0.125f, 1 / std::sqrt(float(std::max(rng.samplesPerPixel(), 1))));
     return s;
 }
 
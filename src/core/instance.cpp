@@ -18,7 +18,13 @@ void Instance::transformFrame(SurfaceEvent &surf) const {
     // step2:  compute normal based on new tangent plane
     // step3:  to build orthogonal basis, recompute bitangent based on tangent and normal
     surf.frame.bitangent = m_transform->apply(surf.frame.bitangent);
-    surf.frame.tangent = m_transform->apply(surf.frame.tangent).normalized();
+    surf.frame.tangent = m_transform->apply(surf.frame.tangent);
+    // the (orthonormal) local frame spans a unit area, which the transform stretches by the length of this cross
+    // product; the area density of the surface point shrinks accordingly
+    const float areaScale = surf.frame.tangent.cross(surf.frame.bitangent).length();
+    surf.pdf /= areaScale;
+    surf.uvScale /= sqrt(areaScale);
+    surf.frame.tangent = surf.frame.tangent.normalized();
     if (m_flipNormal) {
         //clockwise
         surf.frame.normal = surf.frame.bitangent.cross(surf.frame.tangent).normalized();
@@ -29,9 +35,9 @@ void Instance::transformFrame(SurfaceEvent &surf) const {
     }
     surf.frame.bitangent = surf.frame.normal.cross(surf.frame.tangent).normalized();
    
-    if (m_normal != nullptr) {
+    if (m_normal) {
         // [RC] evaluate normals
-        Color norm_color = m_normal->evaluate(surf.uv);
+        Color norm_color = m_normal.evaluate(surf.uv);
         Vector norm_data {2*norm_color.r()-1, 2*norm_color.g()-1, 2*norm_color.b()-1};
         Vector new_normal = norm_data.x() * surf.frame.tangent + 
                             norm_data.y() * surf.frame.bitangent + 
@@ -70,6 +76,12 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its, Sampler &rng) c
     
     // step4: check and update if candidate exists
     bool isIts = m_shape->intersect(localRay, localIts, rng);
+    return acceptLocalIntersection(worldRay, localIts, isIts, its, rng);
+}
+
+bool Instance::acceptLocalIntersection(const Ray &worldRay, const Intersection &localIts, bool isIts,
+                                       Intersection &its, Sampler &rng) const {
+    Intersection worldIts = its;
     // step5: Transform the positon and t from local to world coord
     worldIts.position = m_transform->apply(localIts.position); 
     // assert(worldIts.position[0] != worldRay.origin[0] || worldIts.position[1] != worldRay.origin[1] || worldIts.position[2] != worldRay.origin[2]);
@@ -80,8 +92,8 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its, Sampler &rng) c
     // step6: compare candidate with our original its (then update or do nothing)
     if (isIts && worldIts.t<its.t) {
         // [RC] add a new check for uv, to check whether it is alpha or not.
-        if (m_alpha != nullptr){
-            Color alpha_mask = m_alpha->evaluate(localIts.uv);
+        if (m_alpha) {
+            Color alpha_mask = m_alpha.evaluate(localIts.uv);
             float a = alpha_mask.mean();
             if (rng.next() > a) {
                 return false;
@@ -102,8 +114,44 @@ bool Instance::intersect(const Ray &worldRay, Intersection &its, Sampler &rng) c
     } else {
         return false;
     }
-    // */
+}
+
+RayPacket::Mask Instance::intersectPacket(const RayPacket &worldPacket, RayPacket::Mask mask,
+                                          Intersection *its) const {
+    if (!m_transform) {
+        // fast path, if no transform is needed
+        const RayPacket::Mask hits = m_shape->intersectPacket(worldPacket, mask, its);
+        for (RayPacket::Mask m = hits; m; m &= m - 1) {
+            its[std::countr_zero(m)].instance = this;
+        }
+        return hits;
+    }
+
+    // same as the single ray case, but all rays are moved to object space at once so that the
+    // wrapped shape can still traverse them as a packet
+    RayPacket localPacket;
+    localPacket.size = worldPacket.size;
+    localPacket.rng = worldPacket.rng;
+    std::array<Intersection, RayPacket::MaxSize> localIts;
+    for (RayPacket::Mask m = mask; m; m &= m - 1) {
+        const int i = std::countr_zero(m);
+        localPacket.rays[i] = m_transform->inverse(worldPacket.rays[i]).normalized();
+        localIts[i] = its[i];
+        localIts[i].position = m_transform->inverse(its[i].position);
+        localIts[i].t = INFINITY;
+    }
+    localPacket.computeBounds(mask);
 
+    const RayPacket::Mask localHits = m_shape->intersectPacket(localPacket, mask, localIts.data());
+
+    RayPacket::Mask hits = 0;
+    for (RayPacket::Mask m = mask; m; m &= m - 1) {
+        const int i = std::countr_zero(m);
+        const bool isIts = (localHits >> i) & 1;
+        if (acceptLocalIntersection(worldPacket.rays[i], localIts[i], isIts, its[i], *worldPacket.rng[i]))
+            hits |= RayPacket::Mask(1) << i;
+    }
+    return hits;
 }
 
 Bounds Instance::getBoundingBox() const {
@@ -146,6 +194,18 @@ AreaSample Instance::sampleArea(Sampler &rng) const {
     return sample;
 }
 
+AreaSample Instance::sampleArea(const Point &origin, Sampler &rng) const {
+    if (!m_transform) {
+        // fast path
+        return m_shape->sampleArea(origin, rng);
+    }
+
+    // the shape samples with respect to its own area, which transformFrame converts to an area density in world space
+    AreaSample sample = m_shape->sampleArea(m_transform->inverse(origin), rng);
+    transformFrame(sample);
+    return sample;
+}
+
 }
 
 REGISTER_CLASS(Instance, "instance", "default")
@@ -1,37 +1,176 @@
 #include <lightwave/integrator.hpp>
 #include <lightwave/camera.hpp>
+#include <lightwave/options.hpp>
 #include <lightwave/parallel.hpp>
 
 #include <algorithm>
+#include <array>
+#include <atomic>
 #include <chrono>
+#include <cstring>
+#include <fstream>
+#include <future>
 
 #include <lightwave/streaming.hpp>
 #include <lightwave/iterators.hpp>
 
+#include <tinyexr.h>
+
 namespace lightwave {
 
-void SamplingIntegrator::execute() {
-    if (!m_image) {
-        lightwave_throw("<integrator /> needs an <image /> child to render into!");
+void SamplingIntegrator::renderPacketBlock(const Bounds2i &block) {
+    const float norm = 1.0f / m_sampler->samplesPerPixel();
+
+    // every ray of a packet gets its own sampler, so that each pixel sees the same random sequence as when
+    // rendering without packets
+    RayPacket packet;
+    std::array<ref<Sampler>, RayPacket::MaxSize> samplers;
+    for (int i = 0; i < m_packetSize * m_packetSize; i++) {
+        samplers[i] = m_sampler->clone();
+        packet.rng[i] = samplers[i].get();
     }
 
+    std::array<Point2i, RayPacket::MaxSize> pixels;
+    std::array<Color, RayPacket::MaxSize> weights;
+    std::array<Color, RayPacket::MaxSize> sums;
+    std::array<Intersection, RayPacket::MaxSize> its;
+    for (int y = block.min().y(); y < block.max().y(); y += m_packetSize) {
+        for (int x = block.min().x(); x < block.max().x(); x += m_packetSize) {
+            const Bounds2i tile = block.clip(Bounds2i(
+                Point2i(x, y), Point2i(x + m_packetSize, y + m_packetSize)));
+
+            packet.size = 0;
+            for (auto pixel : tile) {
+                pixels[packet.size] = pixel;
+                sums[packet.size] = Color(0);
+                packet.size++;
+            }
+
+            for (int sample = 0; sample < m_sampler->samplesPerPixel(); sample++) {
+                for (int i = 0; i < packet.size; i++) {
+                    samplers[i]->seed(pixels[i], sample);
+                    auto cameraSample = m_scene->camera()->sample(pixels[i], *samplers[i]);
+                    packet.rays[i] = cameraSample.ray;
+                    weights[i] = cameraSample.weight;
+                }
+                packet.computeBounds(packet.activeMask());
+                m_scene->intersect(packet, its.data());
+
+                for (int i = 0; i < packet.size; i++) {
+                    sums[i] += weights[i] * Li(packet.rays[i], its[i], *samplers[i]);
+                }
+            }
+
+            for (int i = 0; i < packet.size; i++) {
+                m_image->get(pixels[i]) = norm * sums[i];
+            }
+        }
+    }
+}
+
+namespace {
+
+/// @brief The header of checkpoint files, followed by the raw per-pixel estimates in scanline order.
+struct CheckpointHeader {
+    char magic[4] = { 'L', 'W', 'C', 'P' };
+    uint32_t version = 1;
+    /// @brief Guards against reading checkpoints written by builds with a different pixel layout.
+    uint32_t pixelSize;
+    int32_t width, height;
+    int32_t passes;
+};
+
+std::filesystem::path checkpointPath(const Image &image) {
+    return image.basePath() / (image.id() + ".checkpoint");
+}
+
+/// @brief Saves color sums along with a weight channel "W" as single precision EXR.
+void savePartialImage(const std::filesystem::path &path, const Vector2i &resolution,
+                      const std::vector<Color> &sums, const std::vector<float> &weights) {
+    // EXR viewers expect channels in alphabetical order
+    const char *channelNames[] = { "B", "G", "R", "W" };
+    std::vector<float> channels[4];
+    for (auto &channel : channels) channel.resize(sums.size());
+    for (size_t i = 0; i < sums.size(); i++) {
+        channels[0][i] = sums[i].b();
+        channels[1][i] = sums[i].g();
+        channels[2][i] = sums[i].r();
+        channels[3][i] = weights[i];
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    header.compression_type = TINYEXR_COMPRESSIONTYPE_ZIP;
+    header.num_channels = 4;
+
+    std::vector<EXRChannelInfo> channelInfos(4);
+    std::vector<int> pixelTypes(4, TINYEXR_PIXELTYPE_FLOAT);
+    for (int i = 0; i < 4; i++) {
+        std::strncpy(channelInfos[i].name, channelNames[i], 255);
+    }
+    header.channels = channelInfos.data();
+    header.pixel_types = pixelTypes.data();
+    header.requested_pixel_types = pixelTypes.data();
+
+    EXRImage image;
+    InitEXRImage(&image);
+    float *channelPointers[4] = { channels[0].data(), channels[1].data(), channels[2].data(), channels[3].data() };
+    image.images = reinterpret_cast<unsigned char **>(channelPointers);
+    image.num_channels = 4;
+    image.width = resolution.x();
+    image.height = resolution.y();
+
+    logger(EInfo, "saving partial image %s", path);
+    const char *error;
+    if (SaveEXRImageToFile(&image, &header, path.generic_string().c_str(), &error) != TINYEXR_SUCCESS) {
+        logger(EError, "  error saving image %s: %s", path, error);
+        FreeEXRErrorMessage(error);
+    }
+}
+
+}
+
+void SamplingIntegrator::renderPartial(Streaming &stream) {
     const Vector2i resolution = m_scene->camera()->resolution();
-    m_image->initialize(resolution);
+    const int samplesPerPixel = m_sampler->samplesPerPixel();
+    const int sampleBegin = std::min(options.sampleBegin, samplesPerPixel);
+    const int sampleEnd = options.sampleEnd < 0 ? samplesPerPixel : std::min(options.sampleEnd, samplesPerPixel);
+    if (m_adaptive || m_progressive) {
+        logger(EWarn, "adaptive and progressive rendering are not supported for partial renders, rendering %d samples",
+               sampleEnd - sampleBegin);
+    }
 
-    const float norm = 1.0f / m_sampler->samplesPerPixel();
-    
-    Streaming stream { *m_image };
-    ProgressReporter progress { resolution.product() };
-    for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+    // blocks are assigned to workers round-robin in the (deterministic) order of the spiral
+    std::vector<Bounds2i> blocks;
+    int blockIndex = 0;
+    int pixelCount = 0;
+    for (auto block : BlockSpiral(resolution, Vector2i(64))) {
+        if (blockIndex++ % options.tileCount == options.tileIndex) {
+            blocks.push_back(block);
+            pixelCount += block.diagonal().product();
+        }
+    }
+
+    std::vector<Color> sums(resolution.product());
+    std::vector<float> weights(resolution.product());
+    ProgressReporter progress { std::max(pixelCount, 1) };
+    for_each_parallel(blocks.begin(), blocks.end(), [&](const Bounds2i &block) {
         auto sampler = m_sampler->clone();
         for (auto pixel : block) {
+            // samples are seeded by their index, so every worker draws exactly the samples a single process would
             Color sum;
-            for (int sample = 0; sample < m_sampler->samplesPerPixel(); sample++) {
+            for (int sample = sampleBegin; sample < sampleEnd; sample++) {
                 sampler->seed(pixel, sample);
                 auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
                 sum += cameraSample.weight * Li(cameraSample.ray, *sampler);
             }
-            m_image->get(pixel) = norm * sum;
+
+            const int index = pixel.y() * resolution.x() + pixel.x();
+            sums[index] = sum;
+            weights[index] = float(sampleEnd - sampleBegin);
+            if (sampleEnd > sampleBegin) {
+                m_image->get(pixel) = (1.0f / weights[index]) * sum;
+            }
         }
 
         progress += block.diagonal().product();
@@ -39,7 +178,261 @@ void SamplingIntegrator::execute() {
     });
     progress.finish();
 
+    savePartialImage(
+        m_image->basePath() / tfm::format("%s.tiles-%d-of-%d.spp-%d-%d.exr", m_image->id(), options.tileIndex,
+                                          options.tileCount, sampleBegin, sampleEnd),
+        resolution, sums, weights);
+}
+
+void SamplingIntegrator::saveCheckpoint(const std::vector<PixelEstimate> &estimates, int passes) const {
+    const Vector2i resolution = m_scene->camera()->resolution();
+    CheckpointHeader header;
+    header.pixelSize = sizeof(PixelEstimate);
+    header.width = resolution.x();
+    header.height = resolution.y();
+    header.passes = passes;
+
+    // write to a temporary file first, so that a crash while writing never destroys the previous checkpoint
+    const std::filesystem::path path = checkpointPath(*m_image);
+    std::filesystem::path temporaryPath = path;
+    temporaryPath += ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(estimates.data()), estimates.size() * sizeof(PixelEstimate));
+        if (!file) {
+            logger(EError, "could not write checkpoint %s", temporaryPath);
+            return;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error) {
+        logger(EError, "could not write checkpoint %s: %s", path, error.message());
+    }
+}
+
+bool SamplingIntegrator::loadCheckpoint(std::vector<PixelEstimate> &estimates, int &passes) const {
+    const std::filesystem::path path = checkpointPath(*m_image);
+    std::ifstream file(path, std::ios::binary);
+    if (!file) {
+        logger(EWarn, "no checkpoint found at %s, starting from scratch", path);
+        return false;
+    }
+
+    const Vector2i resolution = m_scene->camera()->resolution();
+    CheckpointHeader expected, header;
+    file.read(reinterpret_cast<char *>(&header), sizeof(header));
+    if (!file || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+        header.version != expected.version || header.pixelSize != sizeof(PixelEstimate)) {
+        lightwave_throw("%s is not a valid checkpoint", path);
+    }
+    if (header.width != resolution.x() || header.height != resolution.y()) {
+        lightwave_throw("checkpoint %s has resolution %dx%d, but the camera has %dx%d", path,
+            header.width, header.height, resolution.x(), resolution.y());
+    }
+
+    file.read(reinterpret_cast<char *>(estimates.data()), estimates.size() * sizeof(PixelEstimate));
+    if (!file) {
+        lightwave_throw("checkpoint %s is truncated", path);
+    }
+    passes = header.passes;
+    return true;
+}
+
+void SamplingIntegrator::renderProgressive(Streaming &stream) {
+    const Vector2i resolution = m_scene->camera()->resolution();
+    const int64_t budget = int64_t(resolution.product()) * m_sampler->samplesPerPixel();
+    const int maxSamples = m_adaptive ? m_adaptiveMaxSamples : m_sampler->samplesPerPixel();
+
+    std::vector<PixelEstimate> estimates(resolution.product());
+
+    Timer timer;
+    const auto timeIsUp = [&]() {
+        return m_timeLimit > 0 && timer.getElapsedTime() >= m_timeLimit;
+    };
+
+    int64_t samplesTaken = 0;
+    int batchSize = m_adaptive ? m_adaptiveMinSamples : m_samplesPerPass;
+    int passes = 0;
+    if (options.resume && loadCheckpoint(estimates, passes)) {
+        int activePixels = 0;
+        for (auto pixel : m_image->bounds()) {
+            PixelEstimate &estimate = estimates[pixel.y() * resolution.x() + pixel.x()];
+            samplesTaken += estimate.count;
+            if (estimate.count > 0) {
+                m_image->get(pixel) = (1.0f / estimate.count) * estimate.sum;
+            }
+            // the sample count might have been raised since the checkpoint was written
+            if (estimate.count < maxSamples && !m_adaptive) estimate.converged = false;
+            if (!estimate.converged) activePixels++;
+        }
+        logger(EInfo, "resuming from checkpoint after %d passes with %.1f samples per pixel on average", passes,
+               samplesTaken / float(resolution.product()));
+        if (m_adaptive && activePixels > 0) {
+            batchSize = int(std::clamp<int64_t>((budget - samplesTaken) / activePixels, 1, m_adaptiveMinSamples));
+        }
+    }
+
+    // checkpoints are written by a background thread from a copy of the estimates, so that rendering can continue
+    std::future<void> pendingCheckpoint;
+    Timer checkpointTimer;
+    const auto writeCheckpoint = [&]() {
+        if (pendingCheckpoint.valid()) pendingCheckpoint.wait();
+        pendingCheckpoint = std::async(std::launch::async, [this, snapshot = estimates, passes]() {
+            saveCheckpoint(snapshot, passes);
+        });
+        checkpointTimer = Timer();
+    };
+
+    ProgressReporter progress { 1000 };
+    int progressReported = 0;
+    stream.startRegularUpdates();
+    while (true) {
+        // the first pass always completes, so that every pixel has a valid estimate no matter when we stop
+        const bool mayAbort = passes > 0;
+        std::atomic<int64_t> passSamples = 0;
+        std::atomic<int> activePixels = 0;
+        for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+            if (mayAbort && timeIsUp()) return;
+
+            auto sampler = m_sampler->clone();
+            int64_t blockSamples = 0;
+            int blockActivePixels = 0;
+            for (auto pixel : block) {
+                PixelEstimate &estimate = estimates[pixel.y() * resolution.x() + pixel.x()];
+                if (estimate.converged) continue;
+
+                const int start = estimate.count;
+                const int end = std::min(start + batchSize, maxSamples);
+                for (int sample = start; sample < end; sample++) {
+                    sampler->seed(pixel, sample);
+                    auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                    const Color value = cameraSample.weight * Li(cameraSample.ray, *sampler);
+
+                    estimate.sum += value;
+                    estimate.count++;
+                    const float delta = value.luminance() - estimate.mean;
+                    estimate.mean += delta / estimate.count;
+                    estimate.m2 += delta * (value.luminance() - estimate.mean);
+                }
+                blockSamples += end - start;
+                m_image->get(pixel) = (1.0f / estimate.count) * estimate.sum;
+
+                estimate.converged = estimate.count >= maxSamples;
+                if (m_adaptive && !estimate.converged) {
+                    // the standard error of the mean, compared relative to the mean itself (with a small absolute floor
+                    // so that dark pixels do not demand an excessive number of samples)
+                    const float variance = estimate.count > 1 ? estimate.m2 / (estimate.count - 1) : Infinity;
+                    const float standardError = std::sqrt(variance / estimate.count);
+                    estimate.converged = standardError <= m_adaptiveThreshold * std::max(estimate.mean, 1e-3f);
+                }
+                if (!estimate.converged) blockActivePixels++;
+            }
+
+            passSamples += blockSamples;
+            activePixels += blockActivePixels;
+        });
+        samplesTaken += passSamples;
+        passes++;
+        stream.update();
+
+        if (m_checkpointInterval > 0 && checkpointTimer.getElapsedTime() >= m_checkpointInterval) {
+            writeCheckpoint();
+        }
+
+        const int progressTarget = int(std::min<int64_t>(1000, 1000 * samplesTaken / budget));
+        progress += progressTarget - progressReported;
+        progressReported = progressTarget;
+
+        if (timeIsUp()) {
+            logger(EInfo, "time limit of %.1f seconds reached after %d passes", m_timeLimit, passes);
+            break;
+        }
+        if (activePixels == 0) break;
+
+        if (m_adaptive) {
+            // distribute what remains of the budget evenly over the pixels that have not converged yet
+            const int64_t remaining = budget - samplesTaken;
+            if (remaining < activePixels) break;
+            batchSize = int(std::min<int64_t>(m_adaptiveMinSamples, remaining / activePixels));
+        }
+    }
+    stream.stopRegularUpdates();
+    progress.finish();
+
+    if (m_checkpointInterval > 0) {
+        // always leave a checkpoint of the final state, so that the render can be refined later
+        writeCheckpoint();
+        pendingCheckpoint.wait();
+    }
+
+    logger(EInfo, "rendered %d passes with %.1f samples per pixel on average", passes,
+           samplesTaken / float(resolution.product()));
+
+    if (m_sampleCountImage) {
+        m_sampleCountImage->initialize(resolution);
+        for (auto pixel : m_image->bounds()) {
+            m_sampleCountImage->get(pixel) = Color(float(estimates[pixel.y() * resolution.x() + pixel.x()].count));
+        }
+    }
+}
+
+void SamplingIntegrator::execute() {
+    if (!m_image) {
+        lightwave_throw("<integrator /> needs an <image /> child to render into!");
+    }
+
+    const Vector2i resolution = m_scene->camera()->resolution();
+    m_image->initialize(resolution);
+
+    Streaming stream { *m_image };
+    if (options.isPartialRender()) {
+        // partial images are combined by the merge tool, the (incomplete) output image is not saved
+        renderPartial(stream);
+        return;
+    }
+
+    if (m_adaptive || m_progressive) {
+        renderProgressive(stream);
+    } else {
+        const float norm = 1.0f / m_sampler->samplesPerPixel();
+
+        ProgressReporter progress { resolution.product() };
+        const bool usePackets = m_packetSize > 1 && supportsPacketTracing();
+        for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+            if (usePackets) {
+                renderPacketBlock(block);
+            } else {
+                auto sampler = m_sampler->clone();
+                for (auto pixel : block) {
+                    Color sum;
+                    for (int sample = 0; sample < m_sampler->samplesPerPixel(); sample++) {
+                        sampler->seed(pixel, sample);
+                        auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                        sum += cameraSample.weight * Li(cameraSample.ray, *sampler);
+                    }
+                    m_image->get(pixel) = norm * sum;
+                }
+            }
+
+            progress += block.diagonal().product();
+            stream.updateBlock(block);
+        });
+        progress.finish();
+
+        if (m_sampleCountImage) {
+            m_sampleCountImage->initialize(resolution);
+            for (auto pixel : m_image->bounds()) {
+                m_sampleCountImage->get(pixel) = Color(float(m_sampler->samplesPerPixel()));
+            }
+        }
+    }
+
     m_image->save();
+    if (m_sampleCountImage) {
+        m_sampleCountImage->save();
+    }
 }
 
 }
@@ -0,0 +1,72 @@
+#include <lightwave/light.hpp>
+
+namespace lightwave {
+
+namespace {
+
+/// @brief Rotates a vector around a (normalized) axis by a given angle, using the formula by Rodrigues.
+Vector rotate(const Vector &v, const Vector &axis, float angle) {
+    const float cosAngle = std::cos(angle);
+    const float sinAngle = std::sin(angle);
+    return v * cosAngle + axis.cross(v) * sinAngle + axis * (axis.dot(v) * (1 - cosAngle));
+}
+
+}
+
+void LightBounds::extend(const LightBounds &other) {
+    if (bounds.min().x() > bounds.max().x()) {
+        // nothing has been bounded yet
+        *this = other;
+        return;
+    }
+
+    // find the smallest cone that contains both cones of surface normals
+    const float thetaA = safe_acos(cosThetaO);
+    const float thetaB = safe_acos(other.cosThetaO);
+    const float thetaD = safe_acos(axis.dot(other.axis));
+    if (std::min(thetaD + thetaB, Pi) <= thetaA) {
+        // the other cone lies within this one
+    } else if (std::min(thetaD + thetaA, Pi) <= thetaB) {
+        // this cone lies within the other one
+        axis = other.axis;
+        cosThetaO = other.cosThetaO;
+    } else {
+        const float thetaO = (thetaA + thetaD + thetaB) / 2;
+        const Vector rotationAxis = axis.cross(other.axis);
+        if (thetaO >= Pi || rotationAxis.lengthSquared() == 0) {
+            cosThetaO = -1;
+        } else {
+            // rotate our axis towards the other one, so that the new cone just touches the far side of both cones
+            axis = rotate(axis, rotationAxis.normalized(), thetaO - thetaA).normalized();
+            cosThetaO = std::cos(thetaO);
+        }
+    }
+
+    cosThetaE = std::min(cosThetaE, other.cosThetaE);
+    bounds.extend(other.bounds);
+    power += other.power;
+}
+
+float LightBounds::importance(const Point &origin) const {
+    const Point center = bounds.center();
+    const float radius = bounds.diagonal().length() / 2;
+    const Vector toOrigin = origin - center;
+    const float distanceSquared = toOrigin.lengthSquared();
+
+    // points within the bounding sphere could be illuminated from any direction; we also avoid the importance
+    // blowing up for such points by not letting the distance drop below the radius of the cluster
+    if (distanceSquared <= sqr(radius)) return power / std::max(sqr(radius), Epsilon);
+
+    // the smallest angle between the cone of surface normals and the direction towards the origin, taking into
+    // account that the emitting points can lie anywhere within the bounding sphere
+    const float thetaW = safe_acos(axis.dot(toOrigin / std::sqrt(distanceSquared)));
+    const float thetaO = safe_acos(cosThetaO);
+    const float thetaB = std::asin(std::min(radius / std::sqrt(distanceSquared), 1.0f));
+    const float thetaP = std::max(thetaW - thetaO - thetaB, 0.0f);
+
+    const float cosThetaP = std::cos(thetaP);
+    if (cosThetaP <= cosThetaE) return 0;
+    return power * cosThetaP / distanceSquared;
+}
+
+}
@@ -0,0 +1,151 @@
+/**
+ * @file lighthierarchy.hpp
+ * @brief Contains a bounding volume hierarchy over light sources, used by the scene to pick lights in proportion to their
+ * estimated contribution to a shading point.
+ */
+
+#pragma once
+
+#include <lightwave/light.hpp>
+
+#include <unordered_map>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief A binary tree over lights with finite @ref LightBounds , as used in "Stochastic Lightcuts" [Yuksel 2019] and
+ * "Importance Sampling of Many Lights with Adaptive Tree Splitting" [Conty Estevez and Kulla 2018].
+ * Sampling descends from the root and picks each child in proportion to the importance of its bounds for the shading
+ * point, so that far away, dim or averted clusters of lights are rarely chosen.
+ * @note The probability of having picked a light is recomputed by following the path from the root to its leaf (stored
+ * as a bit trail), which keeps it consistent with sampling as needed for multiple importance sampling.
+ */
+class LightHierarchy {
+    struct Node {
+        /// @brief The bounds of all lights within the subtree of this node.
+        LightBounds bounds;
+        /// @brief The index of the light (for leaves) or the index of the second child (for interior nodes; the
+        /// first child immediately follows its parent).
+        int index;
+        /// @brief Whether this node is a leaf, i.e., contains a single light.
+        bool isLeaf;
+    };
+
+    /// @brief The nodes of the tree in depth-first order, starting with the root.
+    std::vector<Node> m_nodes;
+    /// @brief The lights referenced by the leaves of the tree.
+    std::vector<const Light *> m_lights;
+    /// @brief For each light, the path from the root to its leaf (bit @c i set means the second child is taken at depth @c i ).
+    std::unordered_map<const Light *, uint64_t> m_bitTrails;
+
+    /// @brief Builds the subtree for the given range of lights, splitting at the median along the largest axis.
+    int build(std::vector<std::pair<const Light *, LightBounds>> &lights, int begin, int end, uint64_t bitTrail, int depth) {
+        const int nodeIndex = int(m_nodes.size());
+        m_nodes.emplace_back();
+
+        if (end - begin == 1) {
+            // median splits keep the depth logarithmic, so the bit trail cannot overflow
+            const int lightIndex = int(m_lights.size());
+            m_lights.push_back(lights[begin].first);
+            m_bitTrails[lights[begin].first] = bitTrail;
+            m_nodes[nodeIndex] = { lights[begin].second, lightIndex, true };
+            return nodeIndex;
+        }
+
+        Bounds centroids;
+        for (int i = begin; i < end; i++) centroids.extend(lights[i].second.bounds.center());
+        const Vector extent = centroids.diagonal();
+        int axis = 0;
+        if (extent.y() > extent[axis]) axis = 1;
+        if (extent.z() > extent[axis]) axis = 2;
+
+        const int middle = (begin + end) / 2;
+        std::nth_element(lights.begin() + begin, lights.begin() + middle, lights.begin() + end,
+            [axis](const auto &a, const auto &b) {
+                return a.second.bounds.center()[axis] < b.second.bounds.center()[axis];
+            });
+
+        build(lights, begin, middle, bitTrail, depth + 1);
+        const int second = build(lights, middle, end, bitTrail | (uint64_t(1) << depth), depth + 1);
+
+        LightBounds bounds = m_nodes[nodeIndex + 1].bounds;
+        bounds.extend(m_nodes[second].bounds);
+        m_nodes[nodeIndex] = { bounds, second, false };
+        return nodeIndex;
+    }
+
+    /**
+     * @brief Returns the probability of descending into the first child of an interior node.
+     * @note If neither child is deemed important (e.g., the shading point lies behind all lights), the children are
+     * picked in proportion to their power instead, so that sampling never fails.
+     */
+    float firstChildProbability(int nodeIndex, const Point &origin) const {
+        const LightBounds &first = m_nodes[nodeIndex + 1].bounds;
+        const LightBounds &second = m_nodes[m_nodes[nodeIndex].index].bounds;
+        const float importanceFirst = first.importance(origin);
+        const float importanceSecond = second.importance(origin);
+        if (importanceFirst + importanceSecond > 0) return importanceFirst / (importanceFirst + importanceSecond);
+        if (first.power + second.power > 0) return first.power / (first.power + second.power);
+        return 0.5f;
+    }
+
+public:
+    /// @brief Builds the hierarchy over the given lights and their bounds.
+    LightHierarchy(std::vector<std::pair<const Light *, LightBounds>> lights) {
+        if (lights.empty()) return;
+        m_nodes.reserve(2 * lights.size() - 1);
+        m_lights.reserve(lights.size());
+        build(lights, 0, int(lights.size()), 0, 0);
+    }
+
+    /// @brief Reports whether the hierarchy contains no lights.
+    bool empty() const { return m_lights.empty(); }
+
+    /**
+     * @brief Picks a light for a given shading point using a uniform random number in [0,1), which is remapped at
+     * every level of the tree to steer the next decision.
+     * @param probability Receives the probability of having picked the returned light.
+     */
+    const Light *sample(const Point &origin, float rnd, float &probability) const {
+        probability = 1;
+        int nodeIndex = 0;
+        while (!m_nodes[nodeIndex].isLeaf) {
+            const float p = firstChildProbability(nodeIndex, origin);
+            if (rnd < p) {
+                rnd = std::min(rnd / p, 1 - Epsilon);
+                probability *= p;
+                nodeIndex = nodeIndex + 1;
+            } else {
+                rnd = std::min((rnd - p) / (1 - p), 1 - Epsilon);
+                probability *= 1 - p;
+                nodeIndex = m_nodes[nodeIndex].index;
+            }
+        }
+        return m_lights[m_nodes[nodeIndex].index];
+    }
+
+    /// @brief Returns the probability of @ref sample picking a given light for a given shading point.
+    float pmf(const Light *light, const Point &origin) const {
+        const auto it = m_bitTrails.find(light);
+        if (it == m_bitTrails.end()) return 0;
+
+        uint64_t bitTrail = it->second;
+        float probability = 1;
+        int nodeIndex = 0;
+        while (!m_nodes[nodeIndex].isLeaf) {
+            const float p = firstChildProbability(nodeIndex, origin);
+            if (bitTrail & 1) {
+                probability *= 1 - p;
+                nodeIndex = m_nodes[nodeIndex].index;
+            } else {
+                probability *= p;
+                nodeIndex = nodeIndex + 1;
+            }
+            bitTrail >>= 1;
+        }
+        return probability;
+    }
+};
+
+}
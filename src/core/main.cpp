@@ -1,9 +1,11 @@
 #include <lightwave/core.hpp>
 #include <lightwave/registry.hpp>
 #include <lightwave/logger.hpp>
+#include <lightwave/options.hpp>
 
 #include "parser.hpp"
 
+#include <cstdio>
 #include <fstream>
 
 #ifdef LW_OS_WINDOWS
@@ -12,6 +14,10 @@
 
 using namespace lightwave;
 
+namespace lightwave {
+Options options;
+}
+
 void print_exception(const std::exception &e, int level = 0) {
     logger(EError, "%s%s", std::string(2 * level, ' '), e.what());
     try {
@@ -35,12 +41,37 @@ int main(int argc, const char *argv[]) {
 #endif
 
     try {
-        if (argc <= 1) {
+        std::filesystem::path scenePath;
+        for (int i = 1; i < argc; i++) {
+            const std::string argument = argv[i];
+            if (argument == "--resume") {
+                options.resume = true;
+            } else if (argument == "--tiles" && i + 1 < argc) {
+                // e.g., "--tiles 2/8" renders every eighth block of the image, starting with the third
+                if (std::sscanf(argv[++i], "%d/%d", &options.tileIndex, &options.tileCount) != 2 ||
+                    options.tileCount < 1 || options.tileIndex < 0 || options.tileIndex >= options.tileCount) {
+                    logger(EError, "invalid tiles %s, expected i/N with 0 <= i < N", argv[i]);
+                    return -1;
+                }
+            } else if (argument == "--spp-range" && i + 1 < argc) {
+                // e.g., "--spp-range 64:128" renders the sample indices 64 to 127 of each pixel
+                if (std::sscanf(argv[++i], "%d:%d", &options.sampleBegin, &options.sampleEnd) != 2 ||
+                    options.sampleBegin < 0 || options.sampleEnd <= options.sampleBegin) {
+                    logger(EError, "invalid sample range %s, expected a:b with 0 <= a < b", argv[i]);
+                    return -1;
+                }
+            } else if (argument.starts_with("--")) {
+                logger(EError, "unknown option %s", argument);
+                return -1;
+            } else {
+                scenePath = argument;
+            }
+        }
+
+        if (scenePath.empty()) {
             logger(EError, "please specify path to scene");
             return -1;
         }
-        
-        std::filesystem::path scenePath = argv[1];
 
         SceneParser parser { scenePath };
         for (auto &object : parser.objects()) {
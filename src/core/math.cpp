@@ -148,7 +148,7 @@ Color Intersection::evaluateEmission() const {
 BsdfSample Intersection::sampleBsdf(Sampler &rng) const {
     if (!instance->bsdf()) return BsdfSample::invalid();
     assert_normalized(wo, {});
-    auto bsdfSample = instance->bsdf()->sample(uv, frame.toLocal(wo), rng);
+    auto bsdfSample = instance->bsdf()->samplePrepared(preparedBsdf(), frame.toLocal(wo), rng);
     if (bsdfSample.isInvalid()) return bsdfSample;
     assert_normalized(bsdfSample.wi, {
         logger(EError, "offending BSDF: %s", instance->bsdf()->toString());
@@ -164,7 +164,38 @@ BsdfSample Intersection::sampleBsdf(Sampler &rng) const {
 BsdfEval Intersection::evaluateBsdf(const Vector &wi) const {
     if (!instance->bsdf())
         return BsdfEval::invalid();
-    return instance->bsdf()->evaluate(uv, frame.toLocal(wo), frame.toLocal(wi));
+    return instance->bsdf()->evaluatePrepared(preparedBsdf(), frame.toLocal(wo), frame.toLocal(wi));
+}
+
+float Intersection::pdfBsdf(const Vector &wi) const {
+    if (!instance->bsdf())
+        return 0;
+    return instance->bsdf()->pdfPrepared(preparedBsdf(), frame.toLocal(wo), frame.toLocal(wi));
+}
+
+Color Intersection::albedoBsdf() const {
+    if (!instance->bsdf())
+        return Color::black();
+    return instance->bsdf()->albedoPrepared(preparedBsdf());
+}
+
+const PreparedBsdf &Intersection::preparedBsdf() const {
+    // the queries of a surface point (light sampling, bsdf sampling, multiple importance sampling) follow each other
+    // closely, so remembering the last prepared point of each thread suffices. As the values only depend on the Bsdf
+    // and the texture footprint, a hit never picks up the values of another point.
+    thread_local PreparedBsdf cache;
+    const float footprint = uvFootprint();
+    if (cache.bsdf != instance->bsdf() || cache.uv != uv || cache.footprint != footprint) {
+        cache = instance->bsdf()->prepareAt(uv, footprint);
+    }
+    return cache;
+}
+
+float Intersection::uvFootprint() const {
+    if (footprint == 0) return 0;
+    // the footprint is stretched along one axis at grazing angles, which the isotropic filter approximates by a
+    // footprint of the same area (covering the longer axis entirely would blur the shorter one)
+    return footprint * uvScale / std::sqrt(std::max(Frame::absCosTheta(frame.toLocal(wo)), 1e-4f));
 }
 
 }
@@ -5,12 +5,40 @@
 #include <lightwave/camera.hpp>
 #include <lightwave/light.hpp>
 
+#include "lighthierarchy.hpp"
+
 namespace lightwave {
 
 Scene::Scene(const Properties &properties) {
     m_camera = properties.getChild<Camera>();
     m_background = properties.getOptionalChild<BackgroundLight>();
     m_lights = properties.getChildren<Light>();
+    m_lightSampling = properties.getEnum<LightSampling>("lightSampling", LightSampling::Hierarchy, {
+        { "uniform", LightSampling::Uniform },
+        { "power", LightSampling::Power },
+        { "hierarchy", LightSampling::Hierarchy },
+    });
+
+    std::vector<std::pair<const Light *, LightBounds>> boundedLights;
+    for (const auto &light : m_lights) {
+        if (auto bounds = light->lightBounds()) {
+            boundedLights.emplace_back(light.get(), *bounds);
+        } else {
+            m_infiniteLights.push_back(light.get());
+        }
+    }
+
+    std::vector<float> powers;
+    for (const auto &[light, bounds] : boundedLights) {
+        m_boundedLightIndex[light] = int(m_boundedLights.size());
+        m_boundedLights.push_back(light);
+        powers.push_back(bounds.power);
+    }
+    if (m_lightSampling == LightSampling::Power) {
+        m_lightPower = AliasTable(powers);
+    } else if (m_lightSampling == LightSampling::Hierarchy) {
+        m_lightHierarchy = std::make_shared<LightHierarchy>(std::move(boundedLights));
+    }
     
     const std::vector<ref<Shape>> entities = properties.getChildren<Shape>();
     if (entities.size() == 1) {
@@ -35,10 +63,21 @@ std::string Scene::toString() const {
 
 Intersection Scene::intersect(const Ray &ray, Sampler &rng) const {
     Intersection its(-ray.direction);
-    m_shape->intersect(ray, its, rng);
+    if (m_shape->intersect(ray, its, rng)) its.footprint = ray.widthAt(its.t);
     return its;
 }
 
+void Scene::intersect(const RayPacket &packet, Intersection *its) const {
+    for (int i = 0; i < packet.size; i++) {
+        its[i] = Intersection(-packet.rays[i].direction);
+    }
+    const RayPacket::Mask hits = m_shape->intersectPacket(packet, packet.activeMask(), its);
+    for (RayPacket::Mask m = hits; m; m &= m - 1) {
+        const int i = std::countr_zero(m);
+        its[i].footprint = packet.rays[i].widthAt(its[i].t);
+    }
+}
+
 bool Scene::intersect(const Ray &ray, float tMax, Sampler &rng) const {
     Intersection its(-ray.direction, tMax * (1 - Epsilon));
     return m_shape->intersect(ray, its, rng);
@@ -51,17 +90,61 @@ BackgroundLightEval Scene::evaluateBackground(const Vector &direction) const {
     return m_background->evaluate(direction);
 }
 
-LightSample Scene::sampleLight(Sampler &rng) const {
-    int lightIndex = int(rng.next() * m_lights.size());
-    lightIndex = std::min(lightIndex, int(m_lights.size()) - 1);
+float Scene::infiniteLightProbability() const {
+    const int boundedClusters = m_boundedLights.empty() ? 0 : 1;
+    return float(m_infiniteLights.size()) / (m_infiniteLights.size() + boundedClusters);
+}
+
+LightSample Scene::sampleLight(const Point &origin, Sampler &rng) const {
+    float rnd = rng.next();
+    if (m_lightSampling == LightSampling::Uniform) {
+        int lightIndex = int(rnd * m_lights.size());
+        lightIndex = std::min(lightIndex, int(m_lights.size()) - 1);
+        return {
+            .light = m_lights[lightIndex].get(),
+            .probability = float(1) / m_lights.size(),
+        };
+    }
+
+    // decide between lights without bounds (picked uniformly) and the remaining ones, reusing the random number
+    const float infiniteProbability = infiniteLightProbability();
+    if (rnd < infiniteProbability) {
+        int lightIndex = int(rnd / infiniteProbability * m_infiniteLights.size());
+        lightIndex = std::min(lightIndex, int(m_infiniteLights.size()) - 1);
+        return {
+            .light = m_infiniteLights[lightIndex],
+            .probability = infiniteProbability / m_infiniteLights.size(),
+        };
+    }
+    rnd = std::min((rnd - infiniteProbability) / (1 - infiniteProbability), 1 - Epsilon);
+
+    if (m_lightSampling == LightSampling::Power) {
+        const int lightIndex = m_lightPower.sample(rnd);
+        return {
+            .light = m_boundedLights[lightIndex],
+            .probability = (1 - infiniteProbability) * m_lightPower.pmf(lightIndex),
+        };
+    }
+
+    float probability;
+    const Light *light = m_lightHierarchy->sample(origin, rnd, probability);
     return {
-        .light = m_lights[lightIndex].get(),
-        .probability = float(1) / m_lights.size(),
+        .light = light,
+        .probability = (1 - infiniteProbability) * probability,
     };
 }
 
-float Scene::lightSelectionProbability(const Light *light) const {
-    return float(1) / m_lights.size();
+float Scene::lightSelectionProbability(const Light *light, const Point &origin) const {
+    if (m_lightSampling == LightSampling::Uniform) return float(1) / m_lights.size();
+
+    const auto it = m_boundedLightIndex.find(light);
+    if (it == m_boundedLightIndex.end()) {
+        return m_infiniteLights.empty() ? 0 : infiniteLightProbability() / m_infiniteLights.size();
+    }
+
+    const float boundedProbability = 1 - infiniteLightProbability();
+    if (m_lightSampling == LightSampling::Power) return boundedProbability * m_lightPower.pmf(it->second);
+    return boundedProbability * m_lightHierarchy->pmf(light, origin);
 }
 
 Bounds Scene::getBoundingBox() const {
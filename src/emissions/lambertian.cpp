@@ -3,7 +3,7 @@
 namespace lightwave {
 
 class Lambertian : public Emission {
-    ref<Texture> m_emission;
+    TextureHandle m_emission;
 
 public:
     Lambertian(const Properties &properties) {
@@ -12,7 +12,7 @@ public:
 
     EmissionEval evaluate(const Point2 &uv, const Vector &wo) const override {
         if(Frame::cosTheta(wo) <= 0.f) return EmissionEval::invalid();
-        Color emission = m_emission->evaluate(uv);
+        Color emission = m_emission.evaluate(uv);
         return EmissionEval{
             .value = emission
         };
@@ -16,19 +16,16 @@ public:
      * This will be run for each pixel of the image, potentially with multiple samples for each pixel.
      */
     Color Li(const Ray &ray, Sampler &rng) override {
-        // take the direction of the ray
-        Color albedo = Color::black();
-
-        // check whether the ray has an intersection with objects
-        if (m_scene->intersect(ray,INFINITY,rng)) {
-            Intersection its = m_scene->intersect(ray, rng);
-            if(its.instance->bsdf() != nullptr){
-                albedo = its.instance->bsdf()->albedo(its.uv);
-            }
-        } 
-        return albedo;
+        return Li(ray, m_scene->intersect(ray, rng), rng);
     }
 
+    Color Li(const Ray &ray, const Intersection &its, Sampler &rng) override {
+        // take the albedo of the closest intersection (if any)
+        return its ? its.albedoBsdf() : Color::black();
+    }
+
+    bool supportsPacketTracing() const override { return true; }
+
     /// @brief An optional textual representation of this class, which can be useful for debugging. 
     std::string toString() const override {
         return tfm::format(
@@ -0,0 +1,483 @@
+#include <lightwave.hpp>
+
+#include "emission.hpp"
+#include "mis.hpp"
+
+#include <unordered_map>
+
+namespace lightwave {
+
+/**
+ * @brief Bidirectional path tracing [Veach and Guibas 1995], following the formulation of pbrt: every sample traces a
+ * camera subpath and a light subpath, and connects every prefix of the one to every prefix of the other. The resulting
+ * estimates are combined with the power heuristic, which makes light transport that path tracing struggles with
+ * (e.g., enclosed scenes lit from behind an occluder, or light focused by specular surfaces) much cheaper to render.
+ * Connections to the camera (light tracing) land in arbitrary pixels, and are splatted into a separate film.
+ * @note Light subpaths only start on lights of finite extent. Lights that are infinitely far away are found by camera
+ * subpaths alone, weighted against next event estimation as in the path tracer.
+ */
+class BdptIntegrator : public SamplingIntegrator {
+    struct Vertex {
+        enum class Type { Camera, Light, Surface };
+        Type type = Type::Surface;
+        Point position = Point(0);
+        /// @brief The normal of the surface the vertex lies on, or zero for vertices without a surface (e.g., the camera).
+        Vector normal = Vector(0);
+        /// @brief The surface the vertex lies on (only valid for surface vertices).
+        Intersection its = Intersection();
+        /// @brief The light the vertex lies on, or null if it does not lie on one.
+        const Light *light = nullptr;
+        /// @brief The throughput of the subpath up to the vertex, divided by the density of the subpath.
+        Color weight = Color(0);
+        /// @brief The area density of sampling the vertex from the preceding vertex of its subpath.
+        float pdfFwd = 0;
+        /// @brief The area density of sampling the vertex from the following vertex, i.e., when tracing in reverse.
+        float pdfRev = 0;
+        /// @brief Whether the subpath was continued from this vertex by a Dirac distribution.
+        bool delta = false;
+    };
+
+    /// @brief Storage for the subpaths of one thread, which is reused for all of its samples.
+    struct Subpaths {
+        std::vector<Vertex> camera;
+        std::vector<Vertex> light;
+    };
+
+    /// @brief Temporarily replaces a value, restoring it when going out of scope.
+    template <typename T>
+    class ScopedAssignment {
+        T *m_target = nullptr;
+        T m_backup;
+
+    public:
+        ScopedAssignment() {}
+        ScopedAssignment(T *target, const T &value) : m_target(target) {
+            if (m_target) {
+                m_backup = *m_target;
+                *m_target = value;
+            }
+        }
+        ScopedAssignment(const ScopedAssignment &) = delete;
+        ScopedAssignment &operator=(ScopedAssignment &&other) {
+            if (m_target) *m_target = m_backup;
+            m_target = other.m_target;
+            m_backup = other.m_backup;
+            other.m_target = nullptr;
+            return *this;
+        }
+        ~ScopedAssignment() {
+            if (m_target) *m_target = m_backup;
+        }
+    };
+
+    int m_depth;
+    /// @brief Whether the camera can be connected to, which enables light tracing.
+    bool m_lightTracing;
+    Bounds m_sceneBounds;
+    /// @brief The lights that light subpaths start from (all lights of finite extent).
+    std::vector<const Light *> m_lights;
+    std::unordered_map<const Light *, int> m_lightIndices;
+    /// @brief Picks the light a light subpath starts from, in proportion to the power it emits.
+    AliasTable m_lightDistribution;
+
+    Subpaths &subpaths() const {
+        static thread_local Subpaths storage;
+        if (int(storage.camera.size()) < m_depth + 1) storage.camera.resize(m_depth + 1);
+        if (int(storage.light.size()) < m_depth) storage.light.resize(m_depth);
+        return storage;
+    }
+
+    /// @brief The probability of a light subpath starting from @c light (zero for lights it cannot start from).
+    float lightProbability(const Light *light) const {
+        const auto it = m_lightIndices.find(light);
+        return it == m_lightIndices.end() ? 0 : m_lightDistribution.pmf(it->second);
+    }
+
+    /// @brief Converts a solid angle density at the vertex @c from into an area density at the vertex @c to .
+    static float toArea(float pdf, const Vertex &from, const Vertex &to) {
+        const Vector d = to.position - from.position;
+        const float distanceSquared = d.lengthSquared();
+        if (distanceSquared == 0) return 0;
+        if (to.normal.lengthSquared() > 0) pdf *= std::abs(to.normal.dot(d)) / std::sqrt(distanceSquared);
+        return pdf / distanceSquared;
+    }
+
+    static float pdfBsdf(const Intersection &its, const Vector &wo, const Vector &wi) {
+        Intersection query = its;
+        query.wo = wo;
+        return query.pdfBsdf(wi);
+    }
+
+    /// @brief The solid angle density of the camera sampling the direction towards @c point (among all pixels).
+    float pdfCamera(const Point &point, Sampler &rng) const {
+        if (!m_lightTracing) return 0;
+        return m_scene->camera()->sampleDirect(point, rng).pdf;
+    }
+
+    /// @brief The area density of a light subpath leaving the light vertex @c vertex towards @c next .
+    static float pdfLight(const Vertex &vertex, const Vertex &next) {
+        const Vector direction = (next.position - vertex.position).normalized();
+        return toArea(vertex.light->pdfEmission(vertex.position, vertex.normal, direction).direction, vertex, next);
+    }
+
+    /// @brief The area density of a light subpath starting at the light vertex @c vertex (and leaving towards @c next ).
+    float pdfLightOrigin(const Vertex &vertex, const Vertex &next) const {
+        const Vector direction = (next.position - vertex.position).normalized();
+        return lightProbability(vertex.light) *
+               vertex.light->pdfEmission(vertex.position, vertex.normal, direction).position;
+    }
+
+    /// @brief The area density of sampling @c next from @c vertex , which was reached from @c prev .
+    float pdf(const Vertex &vertex, const Vertex *prev, const Vertex &next, Sampler &rng) const {
+        switch (vertex.type) {
+        case Vertex::Type::Camera:
+            return toArea(pdfCamera(next.position, rng), vertex, next);
+        case Vertex::Type::Light:
+            return pdfLight(vertex, next);
+        case Vertex::Type::Surface:
+            break;
+        }
+        const Vector wo = (prev->position - vertex.position).normalized();
+        const Vector wi = (next.position - vertex.position).normalized();
+        return toArea(pdfBsdf(vertex.its, wo, wi), vertex, next);
+    }
+
+    /// @brief The weight of having found the light @c light by bsdf sampling with density @c bsdfPdf (from @c origin ).
+    float bsdfMisWeight(float bsdfPdf, const Light *light, const Point &origin, const Intersection &its) const {
+        if (!light || !light->canBeIntersected()) return 1;
+        const float lightPdf = m_scene->lightSelectionProbability(light, origin) * light->pdfDirect(origin, its);
+        return powerHeuristic(bsdfPdf, lightPdf);
+    }
+
+    bool occluded(const Point &origin, const Vector &direction, float distance, Sampler &rng) const {
+        return m_scene->intersect(Ray(origin, direction).normalized(), distance, rng);
+    }
+
+    /**
+     * @brief Extends the subpath that starts at @c path[0] by tracing @c ray , until it holds @c maxVertices vertices.
+     * Camera subpaths pass @c background , which receives the light of rays that escape the scene.
+     * @param pdfFwd The solid angle density with which the direction of @c ray was sampled.
+     * @return The number of vertices of the subpath.
+     */
+    int randomWalk(Ray ray, Color weight, float pdfFwd, Vertex *path, int maxVertices, Color *background,
+                   Sampler &rng) const {
+        // camera rays cannot be found by light sampling
+        float bsdfPdf = Infinity;
+        int count = 1;
+        while (count < maxVertices) {
+            const Intersection its = m_scene->intersect(ray, rng);
+            Vertex &prev = path[count - 1];
+            if (!its) {
+                if (background) {
+                    const Color value = m_scene->evaluateBackground(ray.direction).value;
+                    if (value != Color(0)) {
+                        *background += weight * bsdfMisWeight(bsdfPdf, m_scene->background(), ray.origin, its) * value;
+                    }
+                }
+                break;
+            }
+
+            Vertex &vertex = path[count++];
+            vertex = Vertex {
+                .type = Vertex::Type::Surface,
+                .position = its.position,
+                .normal = its.frame.normal,
+                .its = its,
+                .light = its.instance->light(),
+                .weight = weight,
+            };
+            vertex.pdfFwd = toArea(pdfFwd, prev, vertex);
+            if (count >= maxVertices) break;
+
+            const BsdfSample sample = its.sampleBsdf(rng);
+            if (sample.isInvalid()) break;
+            pdfFwd = its.pdfBsdf(sample.wi);
+            float pdfRev = pdfBsdf(its, sample.wi, its.wo);
+            if (pdfFwd == 0) {
+                // dirac bsdfs report a density of zero, such vertices can never be connected to
+                vertex.delta = true;
+                pdfRev = 0;
+            }
+            bsdfPdf = vertex.delta ? Infinity : pdfFwd;
+            prev.pdfRev = toArea(pdfRev, vertex, prev);
+            weight *= sample.weight;
+            ray = Ray(its.position, sample.wi, ray.depth + 1).normalized();
+        }
+        return count;
+    }
+
+    int traceLightPath(Vertex *path, Sampler &rng) const {
+        if (!(m_lightDistribution.total() > 0)) return 0;
+        float remapped;
+        const int index = m_lightDistribution.sample(rng.next(), remapped);
+        const Light *light = m_lights[index];
+        const EmissionSample emission = light->sampleEmission(m_sceneBounds, rng);
+        if (emission.isInvalid()) return 0;
+
+        const float probability = m_lightDistribution.pmf(index);
+        const EmissionPdf pdf = light->pdfEmission(emission.ray.origin, emission.normal, emission.ray.direction);
+        path[0] = Vertex {
+            .type = Vertex::Type::Light,
+            .position = emission.ray.origin,
+            .normal = emission.normal,
+            .light = light,
+            .weight = emission.weight / probability,
+            .pdfFwd = probability * pdf.position,
+        };
+        return randomWalk(emission.ray, emission.weight / probability, pdf.direction, path, m_depth, nullptr, rng);
+    }
+
+    /**
+     * @brief The multiple importance sampling weight of connecting the first @c s vertices of the light subpath to the
+     * first @c t vertices of the camera subpath, where @c sampled replaces the endpoint that was sampled anew for the
+     * connection (if @c s or @c t is one).
+     */
+    float misWeight(Vertex *lightPath, int s, Vertex *cameraPath, int t, const Vertex &sampled, bool lightTracing,
+                    Sampler &rng) const {
+        if (s + t == 2) return 1;
+
+        Vertex *qs = s > 0 ? &lightPath[s - 1] : nullptr;
+        Vertex *pt = &cameraPath[t - 1];
+        Vertex *qsMinus = s > 1 ? &lightPath[s - 2] : nullptr;
+        Vertex *ptMinus = t > 1 ? &cameraPath[t - 2] : nullptr;
+
+        // the densities of the connected path differ from those of the subpaths near the connection
+        ScopedAssignment<Vertex> endpoint;
+        if (s == 1) endpoint = ScopedAssignment<Vertex>(qs, sampled);
+        else if (t == 1) endpoint = ScopedAssignment<Vertex>(pt, sampled);
+
+        ScopedAssignment<bool> ptDelta(&pt->delta, false);
+        ScopedAssignment<bool> qsDelta(qs ? &qs->delta : nullptr, false);
+        ScopedAssignment<float> ptRev(&pt->pdfRev,
+                                      s > 0 ? pdf(*qs, qsMinus, *pt, rng) : pdfLightOrigin(*pt, *ptMinus));
+        ScopedAssignment<float> ptMinusRev(ptMinus ? &ptMinus->pdfRev : nullptr,
+                                           !ptMinus ? 0 : s > 0 ? pdf(*pt, qs, *ptMinus, rng) : pdfLight(*pt, *ptMinus));
+        ScopedAssignment<float> qsRev(qs ? &qs->pdfRev : nullptr, qs ? pdf(*pt, ptMinus, *qs, rng) : 0);
+        ScopedAssignment<float> qsMinusRev(qsMinus ? &qsMinus->pdfRev : nullptr,
+                                           qsMinus ? pdf(*qs, pt, *qsMinus, rng) : 0);
+
+        // sum the ratios of the densities of all other strategies to this one (dirac densities are left out, as they
+        // appear in both and cancel)
+        const auto remap0 = [](float pdf) { return pdf != 0 ? pdf : 1; };
+        float sum = 0;
+        float ratio = 1;
+        for (int i = t - 1; i > 0; i--) {
+            ratio *= sqr(remap0(cameraPath[i].pdfRev) / remap0(cameraPath[i].pdfFwd));
+            if (i == 1 && !lightTracing) continue;
+            if (!cameraPath[i].delta && !cameraPath[i - 1].delta) sum += ratio;
+        }
+        ratio = 1;
+        for (int i = s - 1; i >= 0; i--) {
+            ratio *= sqr(remap0(lightPath[i].pdfRev) / remap0(lightPath[i].pdfFwd));
+            const bool deltaLight = i > 0 ? lightPath[i - 1].delta : !lightPath[0].light->canBeIntersected();
+            if (!lightPath[i].delta && !deltaLight) sum += ratio;
+        }
+        return 1 / (1 + sum);
+    }
+
+    /**
+     * @brief Connects the first @c s vertices of the light subpath to the first @c t vertices of the camera subpath,
+     * returning the weighted contribution of the resulting path. Connections to the camera ( @c t equal to one) report
+     * the pixel they land in through @c pixel .
+     */
+    Color connect(Vertex *lightPath, int s, Vertex *cameraPath, int t, bool lightTracing, Point2i &pixel,
+                  Sampler &rng) const {
+        Vertex sampled;
+        Color contribution;
+        if (s == 0) {
+            // the camera subpath has found a light by itself
+            const Vertex &pt = cameraPath[t - 1];
+            if (!pt.its.instance->emission()) return Color(0);
+            contribution = pt.weight * pt.its.evaluateEmission();
+            if (contribution == Color(0)) return Color(0);
+            if (!(lightProbability(pt.light) > 0)) {
+                // lights that light subpaths cannot start from are only found by the strategies of the path tracer
+                const Vertex &ptMinus = cameraPath[t - 2];
+                const Vector direction = (pt.position - ptMinus.position).normalized();
+                const float bsdfPdf = ptMinus.type == Vertex::Type::Camera || ptMinus.delta ?
+                    Infinity : pdfBsdf(ptMinus.its, ptMinus.its.wo, direction);
+                return contribution * bsdfMisWeight(bsdfPdf, pt.light, ptMinus.position, pt.its);
+            }
+        } else if (t == 1) {
+            // light tracing: connect the light subpath to the camera
+            const Vertex &qs = lightPath[s - 1];
+            const CameraDirectSample camera = m_scene->camera()->sampleDirect(qs.position, rng);
+            if (camera.isInvalid()) return Color(0);
+            contribution = qs.weight * qs.its.evaluateBsdf(camera.wi).value * camera.weight;
+            if (contribution == Color(0) || occluded(qs.position, camera.wi, camera.distance, rng)) return Color(0);
+            pixel = camera.pixel;
+            sampled = Vertex {
+                .type = Vertex::Type::Camera,
+                .position = qs.position + camera.distance * camera.wi,
+            };
+        } else if (s == 1) {
+            // next event estimation: connect the camera subpath to a point sampled on a light
+            const Vertex &pt = cameraPath[t - 1];
+            const LightSample lightSample = m_scene->sampleLight(pt.position, rng);
+            const DirectLightSample direct = lightSample.light->sampleDirect(pt.position, rng);
+            if (direct.isInvalid()) return Color(0);
+            contribution = pt.weight * pt.its.evaluateBsdf(direct.wi).value * direct.weight / lightSample.probability;
+            if (contribution == Color(0) || occluded(pt.position, direct.wi, direct.distance, rng)) return Color(0);
+            if (!(lightProbability(lightSample.light) > 0)) {
+                if (!lightSample.light->canBeIntersected()) return contribution;
+                return contribution *
+                       powerHeuristic(lightSample.probability * direct.pdf, pt.its.pdfBsdf(direct.wi));
+            }
+            sampled = Vertex {
+                .type = Vertex::Type::Light,
+                .position = pt.position + direct.distance * direct.wi,
+                .normal = direct.normal,
+                .light = lightSample.light,
+            };
+            sampled.pdfFwd = pdfLightOrigin(sampled, pt);
+        } else {
+            // connect two surface vertices
+            const Vertex &qs = lightPath[s - 1];
+            const Vertex &pt = cameraPath[t - 1];
+            Vector wi = qs.position - pt.position;
+            const float distance = wi.length();
+            if (distance == 0) return Color(0);
+            wi /= distance;
+            // both bsdfs include the cosine at their vertex, which leaves the squared distance of the geometry term
+            contribution = pt.weight * pt.its.evaluateBsdf(wi).value * qs.its.evaluateBsdf(-wi).value * qs.weight /
+                           sqr(distance);
+            if (contribution == Color(0) || occluded(pt.position, wi, distance, rng)) return Color(0);
+        }
+        return contribution * misWeight(lightPath, s, cameraPath, t, sampled, lightTracing, rng);
+    }
+
+    /**
+     * @brief Traces a camera subpath and a light subpath and combines all of their connections. Connections to the
+     * camera are added to @c splats (if given), all other light is returned.
+     */
+    Color samplePaths(const Ray &cameraRay, const Color &cameraWeight, Sampler &rng, std::vector<Color> *splats) const {
+        Subpaths &paths = subpaths();
+        Vertex *cameraPath = paths.camera.data();
+        Vertex *lightPath = paths.light.data();
+        const bool lightTracing = splats && m_lightTracing;
+
+        Color light;
+        cameraPath[0] = Vertex {
+            .type = Vertex::Type::Camera,
+            .position = cameraRay.origin,
+            .weight = cameraWeight,
+        };
+        const int cameraCount = randomWalk(cameraRay, cameraWeight, pdfCamera(cameraRay(1), rng), cameraPath,
+                                           m_depth + 1, &light, rng);
+        const int lightCount = traceLightPath(lightPath, rng);
+        // next event estimation does not need a light subpath
+        const int maxLightVertices = std::max(lightCount, int(m_scene->hasLights()));
+
+        const int width = m_scene->camera()->resolution().x();
+        for (int t = 1; t <= cameraCount; t++) {
+            for (int s = 0; s <= maxLightVertices; s++) {
+                // the camera can only be connected to light subpaths that have left the light
+                if (t == 1 && (s < 2 || !lightTracing)) continue;
+                if (s + t - 1 > m_depth) continue;
+                Point2i pixel;
+                const Color contribution = connect(lightPath, s, cameraPath, t, lightTracing, pixel, rng);
+                if (t == 1) {
+                    if (contribution != Color(0)) atomicAdd((*splats)[pixel.y() * width + pixel.x()], contribution);
+                } else {
+                    light += contribution;
+                }
+            }
+        }
+        return light;
+    }
+
+public:
+    BdptIntegrator(const Properties &properties)
+    : SamplingIntegrator(properties) {
+        m_depth = properties.get<int>("depth", 5);
+        if (m_depth < 1) {
+            lightwave_throw("bdpt needs depth >= 1");
+        }
+        m_lightTracing = m_scene->camera()->supportsDirectSampling();
+        m_sceneBounds = m_scene->getBoundingBox();
+        for (const auto &light : m_scene->lights()) {
+            if (!light->lightBounds()) continue;
+            m_lightIndices[light.get()] = int(m_lights.size());
+            m_lights.push_back(light.get());
+        }
+        if (!m_lights.empty()) {
+            auto sampler = m_sampler->clone();
+            m_lightDistribution = emittedPowerDistribution(m_lights, m_sceneBounds, *sampler);
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        // without a film to splat into, connections to the camera are left to the other strategies
+        return samplePaths(ray, Color(1), rng, nullptr);
+    }
+
+    void execute() override {
+        if (!m_image) {
+            lightwave_throw("<integrator /> needs an <image /> child to render into!");
+        }
+        if (m_adaptive || m_progressive || options.isPartialRender()) {
+            logger(EWarn, "bdpt splats light tracing samples across the whole image, ignoring progressive, adaptive "
+                          "and partial rendering");
+        }
+        if (!m_lightTracing) {
+            logger(EWarn, "the camera cannot be connected to, light tracing is disabled");
+        }
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_image->initialize(resolution);
+        Streaming stream { *m_image };
+
+        const int spp = m_sampler->samplesPerPixel();
+        std::vector<Color> splats(m_lightTracing ? resolution.product() : 0);
+        ProgressReporter progress { resolution.product() };
+        Timer timer;
+        for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+            auto sampler = m_sampler->clone();
+            for (auto pixel : block) {
+                Color sum;
+                for (int sample = 0; sample < spp; sample++) {
+                    sampler->seed(pixel, sample);
+                    const auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                    sum += samplePaths(cameraSample.ray, cameraSample.weight, *sampler,
+                                       splats.empty() ? nullptr : &splats);
+                }
+                m_image->get(pixel) = sum / float(spp);
+            }
+            progress += block.diagonal().product();
+            stream.updateBlock(block);
+        });
+        progress.finish();
+        const double elapsed = timer.getElapsedTime();
+
+        if (!splats.empty()) {
+            // every sample traced one light subpath, and each of them could have reached any pixel
+            const float norm = 1.f / (float(spp) * resolution.product());
+            for (auto pixel : m_image->bounds()) {
+                m_image->get(pixel) += norm * splats[pixel.y() * resolution.x() + pixel.x()];
+            }
+            stream.update();
+        }
+
+        const double pathPairs = double(spp) * resolution.product();
+        logger(EInfo, "traced %.3g pairs of camera and light subpaths at %.3g per second", pathPairs,
+               pathPairs / std::max(elapsed, 1e-3));
+        m_image->save();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "BdptIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  depth = %d,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_depth
+        );
+    }
+};
+
+}
+
+REGISTER_INTEGRATOR(BdptIntegrator, "bdpt")
@@ -12,11 +12,16 @@ public:
     }
 
     Color Li(const Ray &ray, Sampler &rng) override {
-        Intersection its = m_scene->intersect(ray, rng);
+        return Li(ray, m_scene->intersect(ray, rng), rng);
+    }
+
+    Color Li(const Ray &ray, const Intersection &its, Sampler &rng) override {
         return Color(its.stats.bvhCounter / m_unit,
                      its.stats.primCounter / m_unit, 0);
     }
 
+    bool supportsPacketTracing() const override { return true; }
+
     std::string toString() const override {
         return tfm::format("BVHPerformance[\n"
                            "  sampler = %s,\n"
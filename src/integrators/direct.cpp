@@ -19,7 +19,7 @@ public:
             // next event estimation for light       
             Color light = Color(0.f);
             if(m_scene->hasLights()) {
-                LightSample light_sample = m_scene->sampleLight(rng);
+                LightSample light_sample = m_scene->sampleLight(its.position, rng);
 
                 if(!light_sample.light->canBeIntersected()) { 
                     DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
@@ -0,0 +1,439 @@
+#include <lightwave.hpp>
+
+#include "mis.hpp"
+#include "spatialtree.hpp"
+
+#include <mutex>
+
+namespace lightwave {
+
+/**
+ * @brief A path tracer that decides at every vertex how many continuations to trace, following "EARS: Efficiency-Aware
+ * Russian Roulette and Splitting" [Rath et al. 2022].
+ * Each continuation consists of a light sample and a bsdf sample that is traced further. The expected number of
+ * continuations (the splitting factor) is chosen to maximize the efficiency of the pixel estimate, i.e., the inverse of
+ * its variance times its cost. It grows with the throughput of the path and with the second moment (for russian
+ * roulette) or variance (for splitting) of the radiance reflected at the vertex, and shrinks with the cost (in traced
+ * rays) of a continuation. Factors below one terminate paths (russian roulette), factors above one split them.
+ *
+ * Rendering proceeds in passes of 2, 4, 8, ... samples per pixel (the remaining samples form the last pass). Each pass
+ * records the moments and cost of continuations into a spatial cache, which is refined between passes and steers
+ * the splitting factors of the next pass. The image combines all passes weighted by the inverse of their variance.
+ * @note The first pass traces exactly one continuation per vertex, as there are no statistics to decide from yet.
+ */
+class EarsIntegrator : public SamplingIntegrator {
+    /// @brief The lowest splitting factor, which bounds the variance of russian roulette (as in the original paper).
+    static constexpr float MinFactor = 0.05f;
+
+    int m_depth;
+    /**
+     * @brief The largest splitting factor, which applies to the product of all factors along a path as well, so that
+     * unreliable statistics (e.g., of early passes) cannot make the number of continuations grow exponentially.
+     */
+    float m_maxSplitting;
+    /// @brief The number of continuations a cell must record per pass of one sample per pixel before it is split
+    /// (grows with the square root of the samples per pixel of later passes).
+    float m_spatialThreshold;
+
+    /// @brief The statistics of the continuations of vertices within a cell of the cache.
+    struct Estimates {
+        /// @brief The mean and second moment of the radiance estimate of a continuation, relative to the pixel estimate.
+        float mean = 0;
+        float secondMoment = 0;
+        /// @brief The average number of rays traced by a continuation (including all of its own continuations).
+        float cost = 0;
+
+        /// @brief The statistics recorded in the current pass.
+        AtomicFloat meanSum;
+        AtomicFloat secondMomentSum;
+        AtomicFloat costSum;
+        AtomicFloat count;
+
+        void record(float relativeEstimate, float rays) {
+            meanSum.add(relativeEstimate);
+            secondMomentSum.add(sqr(relativeEstimate));
+            costSum.add(rays);
+            count.add(1);
+        }
+
+        /// @brief Turns the recorded statistics into the estimates used by the next pass.
+        void update() {
+            // without samples, the estimates stay the same (or those inherited from the cell this one was split from)
+            if (count.get() > 0) {
+                mean = meanSum.get() / count.get();
+                secondMoment = secondMomentSum.get() / count.get();
+                cost = costSum.get() / count.get();
+            }
+            meanSum = AtomicFloat();
+            secondMomentSum = AtomicFloat();
+            costSum = AtomicFloat();
+            count = AtomicFloat();
+        }
+
+        void scale(float factor) {
+            meanSum = AtomicFloat(meanSum.get() * factor);
+            secondMomentSum = AtomicFloat(secondMomentSum.get() * factor);
+            costSum = AtomicFloat(costSum.get() * factor);
+            count = AtomicFloat(count.get() * factor);
+        }
+    };
+
+    /**
+     * @brief The statistics of a cell of the cache, kept separately for camera vertices and all other vertices.
+     * Continuations of camera vertices estimate the pixel as a whole, and their second moment (relative to the pixel)
+     * is much lower than that of deeper vertices, whose radiance is relative to a pixel it contributes little to.
+     */
+    struct Leaf {
+        std::array<Estimates, 2> vertices;
+
+        float count() const { return vertices[0].count.get() + vertices[1].count.get(); }
+    };
+
+    std::unique_ptr<SpatialTree<Leaf>> m_cache;
+    /// @brief Whether the cache holds statistics, i.e., splitting factors other than one are used.
+    bool m_learned;
+    /// @brief Whether pixel estimates exist, i.e., statistics are recorded.
+    bool m_hasEstimates;
+    /// @brief The luminance of the current estimate of each pixel (smoothed to suppress noise), used to express
+    /// recorded radiance relative to the pixel it contributes to.
+    Image m_pixelEstimates;
+    /// @brief The variance of a sample of a pixel relative to its squared estimate, averaged over all pixels.
+    float m_imageVariance;
+    /// @brief The average number of rays traced per sample of a pixel.
+    float m_imageCost;
+
+    /// @brief Counts the decisions of a pass, which are reported after it finishes.
+    struct Statistics {
+        int64_t rays = 0;
+        int64_t decisions = 0;
+        int64_t terminated = 0;
+        int64_t split = 0;
+        double factorSum = 0;
+
+        void operator+=(const Statistics &other) {
+            rays += other.rays;
+            decisions += other.decisions;
+            terminated += other.terminated;
+            split += other.split;
+            factorSum += other.factorSum;
+        }
+    };
+
+    /// @brief The state shared by all continuations of a camera sample.
+    struct PathState {
+        Sampler &rng;
+        Statistics &stats;
+        /// @brief The luminance of the estimate of the pixel, or zero if statistics should not be recorded.
+        float pixelEstimate;
+    };
+
+    /// @brief The weight of having found the light @c light by bsdf sampling with density @c bsdfPdf (from @c origin ).
+    float bsdfMisWeight(float bsdfPdf, const Light *light, const Point &origin, const Intersection &its) const {
+        if (!light || !light->canBeIntersected()) return 1;
+        const float lightPdf = m_scene->lightSelectionProbability(light, origin) * light->pdfDirect(origin, its);
+        return powerHeuristic(bsdfPdf, lightPdf);
+    }
+
+    /**
+     * @brief The expected number of continuations to trace at a vertex (see the formula of Rath et al. 2022, Eq. 13).
+     * Terminating a path adds variance in proportion to the second moment of its continuation, but splitting only
+     * removes the variance of the continuation, so the two cases use the respective statistic.
+     * @param pathFactor The product of the splitting factors of all earlier vertices of the path.
+     */
+    float splittingFactor(const Estimates &leaf, const Color &throughput, float pathFactor,
+                          const PathState &state) const {
+        if (!m_learned || !(state.pixelEstimate > 0) || !(leaf.cost > 0)) return 1;
+        // the statistics are relative to the pixel estimate already, and so is the throughput as a consequence
+        const float scale = throughput.luminance() * std::sqrt(m_imageCost / (leaf.cost * m_imageVariance));
+        const float roulette = scale * std::sqrt(leaf.secondMoment);
+        if (!std::isfinite(roulette)) return 1;
+        if (roulette < 1) return std::max(roulette, MinFactor);
+
+        const float splitting = scale * std::sqrt(std::max(leaf.secondMoment - sqr(leaf.mean), 0.f));
+        return clamp(splitting, 1.f, std::max(m_maxSplitting / pathFactor, 1.f));
+    }
+
+    /// @brief Estimates one continuation at a vertex: a light sample plus the radiance found along a bsdf sample.
+    Color continuation(const Intersection &its, int depth, const Color &throughput, float pathFactor,
+                       PathState &state) {
+        Color result(0);
+        if (m_scene->hasLights()) {
+            const LightSample lightSample = m_scene->sampleLight(its.position, state.rng);
+            const DirectLightSample sample = lightSample.light->sampleDirect(its.position, state.rng);
+            if (!sample.isInvalid()) {
+                state.stats.rays++;
+                if (!m_scene->intersect(Ray(its.position, sample.wi), sample.distance, state.rng)) {
+                    const float weight = lightSample.light->canBeIntersected()
+                        ? powerHeuristic(lightSample.probability * sample.pdf, its.pdfBsdf(sample.wi))
+                        : 1.f;
+                    result += weight * sample.weight * its.evaluateBsdf(sample.wi).value / lightSample.probability;
+                }
+            }
+        }
+
+        const BsdfSample sample = its.sampleBsdf(state.rng);
+        if (sample.isInvalid()) return result;
+        // dirac bsdfs report a density of zero, their samples can never be found by light sampling
+        float bsdfPdf = its.pdfBsdf(sample.wi);
+        if (bsdfPdf == 0) bsdfPdf = Infinity;
+
+        const Ray ray(its.position, sample.wi, depth + 1);
+        state.stats.rays++;
+        const Intersection next = m_scene->intersect(ray, state.rng);
+        if (!next) {
+            const Color background = m_scene->evaluateBackground(ray.direction).value;
+            if (background != Color(0))
+                result += sample.weight * bsdfMisWeight(bsdfPdf, m_scene->background(), ray.origin, next) * background;
+            return result;
+        }
+
+        Color incident(0);
+        if (next.instance->emission())
+            incident += bsdfMisWeight(bsdfPdf, next.instance->light(), ray.origin, next) * next.evaluateEmission();
+        incident += reflected(next, depth + 1, throughput * sample.weight, pathFactor, state);
+        return result + sample.weight * incident;
+    }
+
+    /**
+     * @brief Estimates the radiance reflected at a vertex (excluding its emission) by tracing as many continuations
+     * as its splitting factor asks for, recording their statistics into the cache.
+     * @param throughput The weight of the path up to the vertex, including the splitting factors of earlier vertices.
+     * @param pathFactor The product of the splitting factors of earlier vertices.
+     */
+    Color reflected(const Intersection &its, int depth, const Color &throughput, float pathFactor,
+                    PathState &state) {
+        if (depth + 1 >= m_depth || !its.instance->bsdf()) return Color(0);
+
+        Estimates &leaf = m_cache->lookup(its.position).vertices[depth > 0];
+        const float factor = splittingFactor(leaf, throughput, pathFactor, state);
+        // the number of continuations is the factor rounded randomly, so that its expected value is the factor
+        const int count = int(factor) + (state.rng.next() < factor - int(factor));
+        state.stats.decisions++;
+        state.stats.factorSum += factor;
+        if (count == 0) state.stats.terminated++;
+        if (count > 1) state.stats.split++;
+
+        Color sum(0);
+        for (int i = 0; i < count; i++) {
+            const int64_t raysBefore = state.stats.rays;
+            const Color estimate = continuation(its, depth, throughput / factor, pathFactor * factor, state);
+            sum += estimate;
+            if (state.pixelEstimate > 0) {
+                leaf.record(estimate.luminance() / state.pixelEstimate, float(state.stats.rays - raysBefore));
+            }
+        }
+        return sum / factor;
+    }
+
+    /// @brief Traces a camera ray and all of its continuations.
+    Color trace(const Ray &ray, PathState &state) {
+        state.stats.rays++;
+        const Intersection its = m_scene->intersect(ray, state.rng);
+        if (!its) return m_scene->evaluateBackground(ray.direction).value;
+
+        Color result(0);
+        if (its.instance->emission()) result += its.evaluateEmission();
+        return result + reflected(its, 0, Color(1), 1, state);
+    }
+
+    /// @brief The estimates of a pass that feed into the image and into the splitting factors of the next pass.
+    struct PassResult {
+        /// @brief The variance of the image of the pass (the mean over all pixels of the variance of their luminance).
+        float variance;
+        /// @brief The variance of a single sample of each pixel (of its luminance).
+        std::vector<float> sampleVariances;
+        Statistics stats;
+    };
+
+    /// @brief Renders the given range of sample indices (at least two) for all pixels into the image.
+    PassResult renderPass(int firstSample, int sampleCount, Streaming &stream) {
+        const Vector2i resolution = m_scene->camera()->resolution();
+        const float norm = 1.0f / sampleCount;
+        PassResult result { 0, std::vector<float>(resolution.product()), {} };
+        std::mutex mutex;
+        for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+            auto sampler = m_sampler->clone();
+            Statistics stats;
+            for (auto pixel : block) {
+                PathState state { *sampler, stats, m_hasEstimates ? m_pixelEstimates.get(pixel).r() : 0 };
+                Color sum;
+                float luminanceSum = 0;
+                float luminanceSquaredSum = 0;
+                for (int sample = firstSample; sample < firstSample + sampleCount; sample++) {
+                    sampler->seed(pixel, sample);
+                    auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                    const Color value = cameraSample.weight * trace(cameraSample.ray, state);
+                    sum += value;
+                    luminanceSum += value.luminance();
+                    luminanceSquaredSum += sqr(value.luminance());
+                }
+                m_image->get(pixel) = norm * sum;
+                // unbiased sample variance
+                result.sampleVariances[pixel.y() * resolution.x() + pixel.x()] =
+                    std::max(luminanceSquaredSum - sqr(luminanceSum) * norm, 0.f) / (sampleCount - 1);
+            }
+
+            std::lock_guard lock { mutex };
+            result.stats += stats;
+            stream.updateBlock(block);
+        });
+
+        for (float variance : result.sampleVariances) result.variance += variance * norm;
+        result.variance /= resolution.product();
+        return result;
+    }
+
+    /**
+     * @brief Updates the estimates of all pixels from the image rendered so far (filtered with a 3x3 box to suppress
+     * noise), and the relative variance and cost of the image from the last pass.
+     */
+    void updateImageStatistics(const Image &image, const PassResult &pass, int sampleCount) {
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_pixelEstimates.initialize(resolution);
+        double mean = 0;
+        for (auto pixel : image.bounds()) {
+            float sum = 0;
+            int count = 0;
+            for (int dy = -1; dy <= 1; dy++) {
+                for (int dx = -1; dx <= 1; dx++) {
+                    const Point2i neighbor(pixel.x() + dx, pixel.y() + dy);
+                    if (neighbor.x() < 0 || neighbor.y() < 0 || neighbor.x() >= resolution.x() ||
+                        neighbor.y() >= resolution.y())
+                        continue;
+                    sum += image.get(neighbor).luminance();
+                    count++;
+                }
+            }
+            m_pixelEstimates.get(pixel) = Color(sum / count);
+            mean += sum / count;
+        }
+        mean /= resolution.product();
+
+        // dark pixels would otherwise demand extreme splitting factors
+        const float floor = std::max(float(mean) * 1e-2f, Epsilon);
+        double variance = 0;
+        for (auto pixel : image.bounds()) {
+            Color &estimate = m_pixelEstimates.get(pixel);
+            estimate = Color(std::max(estimate.r(), floor));
+            variance += pass.sampleVariances[pixel.y() * resolution.x() + pixel.x()] / sqr(estimate.r());
+        }
+        m_imageVariance = float(variance / resolution.product());
+        m_imageCost = float(pass.stats.rays) / (float(resolution.product()) * sampleCount);
+        m_hasEstimates = true;
+    }
+
+public:
+    EarsIntegrator(const Properties &properties)
+    : SamplingIntegrator(properties) {
+        m_depth = properties.get<int>("depth", 2);
+        m_spatialThreshold = properties.get<float>("spatialThreshold", 4000);
+        // the original paper splits up to 20 times, but statistics that are shared by all vertices of a cell tend to
+        // overestimate the benefit of splitting, so a small cap is more efficient in practice
+        m_maxSplitting = properties.get<float>("maxSplitting", 2);
+        if (m_maxSplitting < 1) {
+            lightwave_throw("maxSplitting must be at least 1, but is %f", m_maxSplitting);
+        }
+        m_cache = std::make_unique<SpatialTree<Leaf>>(m_scene->getBoundingBox());
+        m_learned = false;
+        m_hasEstimates = false;
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        // without statistics of the scene, a single continuation is traced at every vertex
+        Statistics stats;
+        PathState state { rng, stats, 0 };
+        return trace(ray, state);
+    }
+
+    void execute() override {
+        if (!m_image) {
+            lightwave_throw("<integrator /> needs an <image /> child to render into!");
+        }
+        if (m_sampler->samplesPerPixel() < 2) {
+            lightwave_throw("ears needs at least 2 samples per pixel to estimate variances");
+        }
+        if (m_adaptive || m_progressive || options.isPartialRender()) {
+            logger(EWarn, "ears renders in passes that learn splitting factors, ignoring progressive, adaptive and "
+                          "partial rendering");
+        }
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_image->initialize(resolution);
+        Streaming stream { *m_image };
+        m_cache = std::make_unique<SpatialTree<Leaf>>(m_scene->getBoundingBox());
+        m_learned = false;
+        m_hasEstimates = false;
+
+        int remaining = m_sampler->samplesPerPixel();
+        int firstSample = 0;
+        int passSamples = 2;
+        ProgressReporter progress { remaining * resolution.product() };
+        Image combined(resolution);
+        float weightSum = 0;
+        while (remaining > 0) {
+            // passes double in length as long as the last pass receives at least as many samples as the one before
+            const int sampleCount = remaining - passSamples >= 2 * passSamples ? passSamples : remaining;
+            const PassResult pass = renderPass(firstSample, sampleCount, stream);
+
+            // passes without any variance would otherwise receive an infinite weight
+            const float weight = 1 / std::max(pass.variance, Epsilon);
+            for (auto pixel : m_image->bounds()) combined(pixel) += weight * m_image->get(pixel);
+            weightSum += weight;
+            progress += sampleCount * resolution.product();
+            firstSample += sampleCount;
+            remaining -= sampleCount;
+            passSamples *= 2;
+
+            const bool recorded = m_hasEstimates;
+            Image image(resolution);
+            for (auto pixel : m_image->bounds()) image(pixel) = combined(pixel) / weightSum;
+            updateImageStatistics(image, pass, sampleCount);
+            logger(EInfo,
+                   "pass with %d samples per pixel: %.2f rays per sample, relative variance %.3g per sample, "
+                   "%d cells; splitting factor %.2f on average, %.1f%% of %lld vertices terminated, %.1f%% split",
+                   sampleCount, m_imageCost, m_imageVariance, m_cache->leafCount(),
+                   pass.stats.decisions ? pass.stats.factorSum / pass.stats.decisions : 1.,
+                   pass.stats.decisions ? 100. * pass.stats.terminated / pass.stats.decisions : 0.,
+                   (long long) pass.stats.decisions,
+                   pass.stats.decisions ? 100. * pass.stats.split / pass.stats.decisions : 0.);
+            if (remaining == 0 || !recorded) continue;
+
+            const float threshold = m_spatialThreshold * std::sqrt(float(sampleCount));
+            m_cache->subdivide([&](const Leaf &leaf) { return leaf.count() > threshold; },
+                               [](Leaf &leaf) {
+                                   // both halves start out with the statistics of the whole cell
+                                   for (Estimates &estimates : leaf.vertices) estimates.scale(0.5f);
+                               });
+            m_cache->forEachLeaf([](Leaf &leaf) {
+                for (Estimates &estimates : leaf.vertices) estimates.update();
+            });
+            m_learned = true;
+        }
+        progress.finish();
+
+        for (auto pixel : m_image->bounds()) m_image->get(pixel) = combined(pixel) / weightSum;
+        stream.update();
+        m_image->save();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "EarsIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  depth = %d,\n"
+            "  spatialThreshold = %f,\n"
+            "  maxSplitting = %f,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_depth,
+            m_spatialThreshold,
+            m_maxSplitting
+        );
+    }
+};
+
+}
+
+REGISTER_INTEGRATOR(EarsIntegrator, "ears")
@@ -0,0 +1,37 @@
+/**
+ * @brief Picking lights to start paths from, shared by the integrators that trace paths from the lights.
+ * @file emission.hpp
+ */
+
+#pragma once
+
+#include <lightwave/distribution.hpp>
+#include <lightwave/light.hpp>
+#include <lightwave/sampler.hpp>
+
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Builds a distribution that picks each of the given lights in proportion to the luminance of its emitted power,
+ * which is estimated from a fixed number of samples of @ref Light::sampleEmission . Lights that cannot emit rays are
+ * never picked (unless no light can, in which case all lights are equally likely).
+ */
+inline AliasTable emittedPowerDistribution(const std::vector<const Light *> &lights, const Bounds &sceneBounds,
+                                           Sampler &sampler) {
+    static constexpr int SampleCount = 1024;
+    std::vector<float> powers;
+    for (const Light *light : lights) {
+        double power = 0;
+        for (int i = 0; i < SampleCount; i++) {
+            sampler.seed(i);
+            const EmissionSample sample = light->sampleEmission(sceneBounds, sampler);
+            if (!sample.isInvalid()) power += sample.weight.luminance() / SampleCount;
+        }
+        powers.push_back(float(power));
+    }
+    return AliasTable(powers);
+}
+
+}
@@ -0,0 +1,304 @@
+#include <lightwave.hpp>
+
+#include "mis.hpp"
+#include "roulette.hpp"
+#include "sdtree.hpp"
+
+namespace lightwave {
+
+/**
+ * @brief A path tracer that guides the directions of paths towards the incident radiance learned by an @ref SDTree ,
+ * following "Practical Path Guiding for Efficient Light-Transport Simulation" [Müller et al. 2017].
+ * Rendering starts with training passes of 1, 2, 4, ... samples per pixel, each of which records the radiance found
+ * by its paths and refines the tree for the next pass. The remaining samples (at least half of the budget of the
+ * sampler) are then rendered with the final distribution. The image combines all passes weighted by the inverse of
+ * their estimated variance ("Path Guiding in Production" [Müller 2019]), so that early passes, which are guided
+ * poorly, contribute little.
+ * @note Directions are sampled from a mixture of the bsdf and the learned distribution (one-sample multiple importance
+ * sampling), so that the bsdf still covers all directions the learned distribution might miss. Dirac bsdfs are never guided.
+ */
+class GuidedPathTracerIntegrator : public SamplingIntegrator {
+    /// @brief The maximum number of vertices per path whose incident radiance is recorded.
+    static constexpr int MaxRecordedVertices = 32;
+
+    int m_depth;
+    int m_rrDepth;
+    /// @brief The probability of sampling the bsdf instead of the learned distribution.
+    float m_bsdfSamplingFraction;
+    /// @brief The number of samples a spatial cell must record per training pass of one sample per pixel before it
+    /// is split (grows with the square root of the samples per pixel of later passes).
+    float m_spatialThreshold;
+    /// @brief The fraction of the radiance of a directional tree above which a cell of it is subdivided.
+    float m_directionalThreshold;
+
+    std::unique_ptr<SDTree> m_tree;
+
+    /// @brief The sampling decisions at a path vertex.
+    struct Vertex {
+        /// @brief The distribution learned for the vertex, or @c nullptr if it is not guided.
+        const DirectionalTree *guide = nullptr;
+        /// @brief The distribution that records the incident radiance at the vertex, or @c nullptr if not training.
+        DirectionalTree *record = nullptr;
+    };
+
+    /// @brief A vertex whose incident radiance along its sampled direction is recorded once the path is complete.
+    struct RecordedVertex {
+        DirectionalTree *tree;
+        Vector direction;
+        float pdf;
+        /// @brief The throughput of the path up to (and including) the sampled direction.
+        Color throughput;
+        /// @brief The radiance found along the sampled direction.
+        Color radiance;
+    };
+
+    /// @brief The density of sampling a direction at a vertex (from the mixture, if the vertex is guided).
+    float pdf(const Intersection &its, const Vertex &vertex, const Vector &wi) const {
+        const float bsdfPdf = its.pdfBsdf(wi);
+        if (!vertex.guide) return bsdfPdf;
+        return m_bsdfSamplingFraction * bsdfPdf + (1 - m_bsdfSamplingFraction) * vertex.guide->pdf(wi);
+    }
+
+    /**
+     * @brief Samples the next direction of a path, reporting its weight and density.
+     * @note The bsdf is always sampled first, which identifies Dirac bsdfs (whose samples have zero density) without
+     * needing to know their type. Mixing with the learned distribution happens only for the other bsdfs.
+     */
+    BsdfSample sampleDirection(const Intersection &its, Vertex &vertex, float &samplePdf, Sampler &rng) const {
+        const float rnd = rng.next();
+        BsdfSample sample = its.sampleBsdf(rng);
+        const float bsdfPdf = sample.isInvalid() ? 0 : its.pdfBsdf(sample.wi);
+        if (!sample.isInvalid() && bsdfPdf == 0) {
+            // dirac bsdfs can only be sampled by themselves
+            vertex = {};
+            samplePdf = Infinity;
+            return sample;
+        }
+        if (!vertex.guide) {
+            samplePdf = bsdfPdf;
+            return sample;
+        }
+
+        if (rnd >= m_bsdfSamplingFraction) sample.wi = vertex.guide->sample(rng.next2D());
+        else if (sample.isInvalid()) return sample;
+
+        samplePdf = pdf(its, vertex, sample.wi);
+        if (!(samplePdf > 0)) return BsdfSample::invalid();
+        sample.weight = its.evaluateBsdf(sample.wi).value / samplePdf;
+        return sample;
+    }
+
+    /// @brief The weight of having found the light @c light by directional sampling with density @c samplePdf (from @c origin ).
+    float misWeight(float samplePdf, const Light *light, const Point &origin, const Intersection &its) const {
+        if (!light || !light->canBeIntersected()) return 1;
+        const float lightPdf = m_scene->lightSelectionProbability(light, origin) * light->pdfDirect(origin, its);
+        return powerHeuristic(samplePdf, lightPdf);
+    }
+
+    /// @brief Traces a path, recording the radiance found at its vertices into the tree if @c train is set.
+    Color trace(const Ray &cameraRay, Sampler &rng, bool train) {
+        std::array<RecordedVertex, MaxRecordedVertices> recorded;
+        int recordedCount = 0;
+
+        Color result(0);
+        Color throughput(1);
+        // adds radiance that reaches the camera through the current throughput; each vertex of the path sees the same
+        // radiance divided by the throughput up to it, except that the last vertex sees emission without the weight of
+        // multiple importance sampling (as light sampling does not estimate the radiance along its direction)
+        const auto contribute = [&](const Color &value, const Color &unweightedValue) {
+            result += throughput * value;
+            for (int i = 0; i < recordedCount; i++) {
+                RecordedVertex &vertex = recorded[i];
+                const Color radiance = throughput * (i == recordedCount - 1 ? unweightedValue : value);
+                for (int channel = 0; channel < Color::NumComponents; channel++) {
+                    if (vertex.throughput[channel] > 0) vertex.radiance[channel] += radiance[channel] / vertex.throughput[channel];
+                }
+            }
+        };
+
+        Ray ray = cameraRay;
+        float samplePdf = Infinity; // camera rays cannot be found by light sampling
+        for (int depth = 0;; depth++) {
+            const Intersection its = m_scene->intersect(ray, rng);
+            if (!its) {
+                const Color background = m_scene->evaluateBackground(ray.direction).value;
+                if (background != Color(0))
+                    contribute(misWeight(samplePdf, m_scene->background(), ray.origin, its) * background, background);
+                break;
+            }
+
+            if (its.instance->emission()) {
+                const Color emission = its.evaluateEmission();
+                contribute(misWeight(samplePdf, its.instance->light(), ray.origin, its) * emission, emission);
+            }
+            if (depth + 1 >= m_depth) break;
+
+            Vertex vertex;
+            if (its.instance->bsdf()) {
+                SDTree::Leaf &leaf = m_tree->lookup(its.position);
+                if (leaf.sampling.total() > 0) vertex.guide = &leaf.sampling;
+                if (train) vertex.record = &leaf.building;
+            }
+
+            // next event estimation, weighted against finding the light by directional sampling
+            if (m_scene->hasLights()) {
+                const LightSample lightSample = m_scene->sampleLight(its.position, rng);
+                const DirectLightSample sample = lightSample.light->sampleDirect(its.position, rng);
+                if (!sample.isInvalid() &&
+                    !m_scene->intersect(Ray(its.position, sample.wi), sample.distance, rng)) {
+                    const float weight = lightSample.light->canBeIntersected()
+                        ? powerHeuristic(lightSample.probability * sample.pdf, pdf(its, vertex, sample.wi))
+                        : 1.f;
+                    const Color value = weight * sample.weight * its.evaluateBsdf(sample.wi).value /
+                                        lightSample.probability;
+                    contribute(value, value);
+                }
+            }
+
+            const BsdfSample sample = sampleDirection(its, vertex, samplePdf, rng);
+            if (sample.isInvalid()) break;
+            throughput *= sample.weight;
+
+            if (vertex.record && recordedCount < MaxRecordedVertices) {
+                recorded[recordedCount++] = { vertex.record, sample.wi, samplePdf, throughput, Color(0) };
+            }
+
+            if (depth + 1 >= m_rrDepth && !russianRoulette(throughput, rng)) break;
+            ray = Ray(its.position, sample.wi, depth + 1);
+        }
+
+        for (int i = 0; i < recordedCount; i++) {
+            const RecordedVertex &vertex = recorded[i];
+            vertex.tree->record(vertex.direction, vertex.radiance.luminance() / vertex.pdf);
+        }
+        return result;
+    }
+
+    /**
+     * @brief Renders the given range of sample indices for all pixels into the image, returning an estimate of the
+     * variance of the result (the mean over all pixels of the variance of their luminance), or infinity if the pass
+     * has too few samples to estimate it.
+     */
+    float renderPass(int firstSample, int sampleCount, bool train, Streaming &stream) {
+        const float norm = 1.0f / sampleCount;
+        AtomicFloat variance;
+        for_each_parallel(BlockSpiral(m_scene->camera()->resolution(), Vector2i(64)), [&](auto block) {
+            auto sampler = m_sampler->clone();
+            float blockVariance = 0;
+            for (auto pixel : block) {
+                Color sum;
+                float luminanceSum = 0;
+                float luminanceSquaredSum = 0;
+                for (int sample = firstSample; sample < firstSample + sampleCount; sample++) {
+                    sampler->seed(pixel, sample);
+                    auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                    const Color value = cameraSample.weight * trace(cameraSample.ray, *sampler, train);
+                    sum += value;
+                    luminanceSum += value.luminance();
+                    luminanceSquaredSum += sqr(value.luminance());
+                }
+                m_image->get(pixel) = norm * sum;
+                if (sampleCount > 1) {
+                    // unbiased sample variance, divided by the number of samples for the variance of the mean
+                    blockVariance += std::max(luminanceSquaredSum - sqr(luminanceSum) * norm, 0.f) /
+                                     (sampleCount - 1) * norm;
+                }
+            }
+            variance.add(blockVariance);
+            stream.updateBlock(block);
+        });
+        if (sampleCount < 2) return Infinity;
+        return variance.get() / m_scene->camera()->resolution().product();
+    }
+
+public:
+    GuidedPathTracerIntegrator(const Properties &properties)
+    : SamplingIntegrator(properties) {
+        m_depth = properties.get<int>("depth", 2);
+        // paths are subject to russian roulette from this depth on (disabled by default)
+        m_rrDepth = properties.get<int>("rrDepth", m_depth);
+        m_bsdfSamplingFraction = properties.get<float>("bsdfSamplingFraction", 0.5f);
+        m_spatialThreshold = properties.get<float>("spatialThreshold", 12000);
+        m_directionalThreshold = properties.get<float>("directionalThreshold", 0.01f);
+        if (m_bsdfSamplingFraction <= 0 || m_bsdfSamplingFraction > 1) {
+            lightwave_throw("bsdfSamplingFraction must lie in (0,1], but is %f", m_bsdfSamplingFraction);
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        return trace(ray, rng, false);
+    }
+
+    void execute() override {
+        if (!m_image) {
+            lightwave_throw("<integrator /> needs an <image /> child to render into!");
+        }
+        if (m_adaptive || m_progressive || options.isPartialRender()) {
+            logger(EWarn, "guided path tracing renders in training passes, ignoring progressive, adaptive and "
+                          "partial rendering");
+        }
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_image->initialize(resolution);
+        Streaming stream { *m_image };
+        m_tree = std::make_unique<SDTree>(m_scene->getBoundingBox());
+
+        // train with doubling sample counts as long as at least half of the budget remains for the final pass
+        int remaining = m_sampler->samplesPerPixel();
+        int firstSample = 0;
+        int passSamples = 1;
+        ProgressReporter progress { remaining * resolution.product() };
+        Image combined(resolution);
+        float weightSum = 0;
+        const auto combine = [&](float variance) {
+            if (!(variance < Infinity)) return;
+            // passes without any variance would otherwise receive an infinite weight
+            const float weight = 1 / std::max(variance, Epsilon);
+            for (auto pixel : m_image->bounds()) combined(pixel) += weight * m_image->get(pixel);
+            weightSum += weight;
+        };
+
+        while (remaining - passSamples >= 2 * passSamples) {
+            combine(renderPass(firstSample, passSamples, true, stream));
+            m_tree->refine(m_spatialThreshold * std::sqrt(float(passSamples)), m_directionalThreshold);
+            logger(EInfo, "trained with %d samples per pixel, the tree has %d spatial cells", passSamples,
+                   m_tree->leafCount());
+
+            progress += passSamples * resolution.product();
+            firstSample += passSamples;
+            remaining -= passSamples;
+            passSamples *= 2;
+        }
+
+        const float finalVariance = renderPass(firstSample, remaining, false, stream);
+        progress.finish();
+        if (finalVariance < Infinity) {
+            combine(finalVariance);
+            for (auto pixel : m_image->bounds()) m_image->get(pixel) = combined(pixel) / weightSum;
+        }
+        stream.update();
+
+        m_image->save();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "GuidedPathTracerIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  depth = %d,\n"
+            "  rrDepth = %d,\n"
+            "  bsdfSamplingFraction = %f,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_depth,
+            m_rrDepth,
+            m_bsdfSamplingFraction
+        );
+    }
+};
+
+}
+
+REGISTER_INTEGRATOR(GuidedPathTracerIntegrator, "guided")
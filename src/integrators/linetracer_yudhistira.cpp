@@ -1,10 +1,13 @@
 #include <lightwave.hpp>
 
+#include "roulette.hpp"
+
 namespace lightwave {
 
 class LineDistanceTracerIntegrator : public SamplingIntegrator {
 
     int m_depth;
+    int m_rrDepth;
     bool nee;
 
     float w_screen;      //The line width in screen-space. Notation refers to the paper
@@ -19,6 +22,8 @@ public:
     : SamplingIntegrator(properties) {
         max_distance = properties.get<float>("maxDistance", 40.f);
         m_depth = properties.get<int>("depth", 2);
+        // paths are subject to russian roulette from this depth on (disabled by default)
+        m_rrDepth = properties.get<int>("rrDepth", m_depth);
         nee     = properties.get<bool>("nee", true);
 
         w_screen   = properties.get<float>("wscreen", 0.15f);  //this, combined with the pixel width in instance, determines the line width in screen-space. Notation refers to the paper
@@ -30,7 +35,7 @@ public:
     
     bool isLine_Metric(const Intersection &sample_its, const Intersection &target_its, const Color &target_albedo, Sampler &rng){
         if (sample_its.instance->id() != target_its.instance->id())                                return true;  //check if the sample point is on the same object
-        else if((sample_its.sampleBsdf(rng).weight - target_albedo).lengthSquared() > tao_albedo ) return true; //check if the sample point is on the same material/ color region, take the square as metric for saving computation cost
+        else if((sample_its.albedoBsdf() - target_albedo).lengthSquared() > tao_albedo ) return true; //check if the sample point is on the same material/ color region, take the square as metric for saving computation cost
         else if((1.f - abs(sample_its.frame.normal.dot(target_its.frame.normal))) > tao_normal)    return true; //check if the sample point is on the same surface, take the square as metric for saving computation cost
         // else { //check if the sample point is on similar depth, equation refers to the paper
         //     if (sample_its.t < target_its.t) {
@@ -59,7 +64,7 @@ public:
         prev_w_scaled  = w_scaled;
 
         //for saving computation cost, later we only compute the albedo of the sample point
-        Color target_albedo = target_its.sampleBsdf(rng).weight;
+        Color target_albedo = target_its.albedoBsdf();
         
         for(int i = 0; i < line_samplecount; i++){
             //generate a random point on the tangent plane
@@ -149,7 +154,7 @@ public:
 
                     if(nee && bounceRay.depth < m_depth-1){
                         // nne is recognized as a new bounce, for last bounce, nne is not considered
-                        LightSample light_sample = m_scene->sampleLight(rng);
+                        LightSample light_sample = m_scene->sampleLight(its.position, rng);
 
                         if(!light_sample.light->canBeIntersected()) { 
                             DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
@@ -175,6 +180,8 @@ public:
 
                     if(bounceRay.depth >= m_depth-1) break; //no need to update bounceRay, shortcut
 
+                    if(bounceRay.depth+1 >= m_rrDepth && !russianRoulette(prev_weight, rng)) break; //terminated paths contribute no further light
+
                     //update bounceRay for next iteration, depth +1
                     bounceRay = Ray(its.position, sample_result.wi, bounceRay.depth+1).normalized();             
                 }
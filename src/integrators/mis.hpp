@@ -0,0 +1,26 @@
+/**
+ * @brief Weighting functions for multiple importance sampling, shared by the integrators that combine light and bsdf sampling.
+ * @file mis.hpp
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+
+namespace lightwave {
+
+/**
+ * @brief The power heuristic (with exponent two) by Veach, weighting a sample produced by strategy A against the
+ * density with which strategy B would have produced it.
+ * @note Densities of @c Infinity denote Dirac strategies (e.g., point lights or mirrors), whose samples can never be
+ * found by any other strategy and hence receive the full weight.
+ */
+inline float powerHeuristic(float pdfA, float pdfB) {
+    if (std::isinf(pdfA)) return 1;
+    if (std::isinf(pdfB)) return 0;
+    pdfA *= pdfA;
+    pdfB *= pdfB;
+    return pdfA + pdfB > 0 ? pdfA / (pdfA + pdfB) : 0;
+}
+
+}
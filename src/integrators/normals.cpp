@@ -16,16 +16,12 @@ public:
      * This will be run for each pixel of the image, potentially with multiple samples for each pixel.
      */
     Color Li(const Ray &ray, Sampler &rng) override {
-        // take the direction of the ray
-        Vector d;
+        return Li(ray, m_scene->intersect(ray, rng), rng);
+    }
 
-        // check whether the ray has an intersection with objects
-        if (m_scene->intersect(ray,INFINITY,rng)) {
-            Intersection its = m_scene->intersect(ray, rng);
-            d = its.frame.normal;  
-        } 
-        else d = Vector(0.f);   
-            
+    Color Li(const Ray &ray, const Intersection &its, Sampler &rng) override {
+        // take the normal of the closest intersection (if any)
+        Vector d = its ? its.frame.normal : Vector(0.f);
 
         if (m_remap) {
             // remap the direction from [-1,+1]^3 to [0,+1]^3 so that colors channels are never negative
@@ -34,6 +30,8 @@ public:
         return Color(d);
     }
 
+    bool supportsPacketTracing() const override { return true; }
+
     /// @brief An optional textual representation of this class, which can be useful for debugging. 
     std::string toString() const override {
         return tfm::format(
@@ -1,16 +1,57 @@
 #include <lightwave.hpp>
 
+#include "mis.hpp"
+#include "radiancecache.hpp"
+#include "roulette.hpp"
+
+#include <filesystem>
+#include <optional>
+
 namespace lightwave {
 
 class PathTracerIntegrator : public SamplingIntegrator {
     int m_depth;
+    int m_rrDepth;
     bool nee;
+    bool m_mis;
+
+    /// @brief Whether paths end at their second diffuse vertex by looking up the radiance cache.
+    bool m_useCache;
+    /// @brief The largest error with which cache records are interpolated (see @ref RadianceCache ).
+    float m_cacheError;
+    /// @brief The number of paths traced to estimate the radiance of each cache record.
+    int m_cacheSamples;
+    /// @brief Side length (in pixels) of the blocks that each trace one camera path to place cache records.
+    int m_cacheSpacing;
+    /// @brief An optional file the cache is loaded from (if it exists) or saved to, to reuse it for static scenes.
+    std::optional<std::filesystem::path> m_cacheFile;
+    std::unique_ptr<RadianceCache> m_cache;
 
 public:
     PathTracerIntegrator(const Properties &properties)
     : SamplingIntegrator(properties) {
         m_depth = properties.get<int>("depth", 2);
+        // paths are subject to russian roulette from this depth on (disabled by default)
+        m_rrDepth = properties.get<int>("rrDepth", m_depth);
         nee     = properties.get<bool>("nee", true);
+        // weight light and bsdf samples with the power heuristic, which also enables light sampling for lights that can be hit
+        m_mis   = properties.get<bool>("mis", true);
+
+        m_useCache     = properties.get<bool>("radianceCache", false);
+        m_cacheError   = properties.get<float>("cacheError", 0.3f);
+        m_cacheSamples = properties.get<int>("cacheSamples", 256);
+        m_cacheSpacing = properties.get<int>("cacheSpacing", 4);
+        if (properties.has("cacheFile")) m_cacheFile = properties.get<std::filesystem::path>("cacheFile");
+        if (m_useCache && (m_cacheError <= 0 || m_cacheSamples < 1 || m_cacheSpacing < 1)) {
+            lightwave_throw("the radiance cache needs a positive cacheError, cacheSamples and cacheSpacing");
+        }
+    }
+
+    /// @brief The weight of having found the light @c light by bsdf sampling with density @c bsdfPdf (from @c origin ).
+    float bsdfMisWeight(float bsdfPdf, const Light *light, const Point &origin, const Intersection &its) const {
+        if (!m_mis || !nee || !light || !light->canBeIntersected()) return 1;
+        const float lightPdf = m_scene->lightSelectionProbability(light, origin) * light->pdfDirect(origin, its);
+        return powerHeuristic(bsdfPdf, lightPdf);
     }
 
     /**
@@ -37,7 +78,7 @@ public:
             // check any intersection with existing light sources
             if(nee && ray.depth < m_depth-1){
                 // nne is recognized as a new bounce, for last bounce, nne is not considered
-                LightSample light_sample = m_scene->sampleLight(rng);
+                LightSample light_sample = m_scene->sampleLight(its.position, rng);
 
                 if(!light_sample.light->canBeIntersected()) { 
                     DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
@@ -78,75 +119,233 @@ public:
             Color outLight = RecurseRay(ray, rng);
             return outLight;
         } else {
-            assert(m_depth >= 2);
-            if(!m_scene->hasLights()) nee = false;
-            /*
-            incremental update:
-            prev_le <- prev_le + prev_weight * new_le
-            prev_weight <- prev_weight * new_weight
-            */
-            Color prev_weight = Color(1.f);
-            Color prev_le     = Color(0.f);
-            Color new_li      = Color(0.f);
-            Ray   bounceRay   = ray; //with depth ==0
-
-            while(bounceRay.depth < m_depth){
-                // update ray and its depth
-                // every event check light(nne)            
-                Intersection its = m_scene->intersect(bounceRay, rng);
-                if(!its) {
-                    // only break when escape the scene
-                    new_li = m_scene->evaluateBackground(bounceRay.direction).value;
-                    break;
-                } 
-                else{
-                    Color new_le      = Color(0.f);
-                    Color new_weight  = Color(1.f);
-
-                    if(nee && bounceRay.depth < m_depth-1){
-                        // nne is recognized as a new bounce, for last bounce, nne is not considered
-                        LightSample light_sample = m_scene->sampleLight(rng);
-
-                        if(!light_sample.light->canBeIntersected()) { 
-                            DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
-                            bool              light_its           = m_scene->intersect( Ray(its.position, direct_light_sample.wi).normalized(),direct_light_sample.distance,rng);
-
-                            if(!light_its)
-                            {
-                                BsdfEval bsdf_eval                = its.evaluateBsdf(direct_light_sample.wi);
-                                        new_le                  += direct_light_sample.weight * bsdf_eval.value / light_sample.probability;
-                            }
+            return Li(ray, m_scene->intersect(ray, rng), rng);
+        }
+    }
+
+    /// @brief Iterative path tracing, starting from an already intersected camera ray (e.g., from packet tracing).
+    Color Li(const Ray &ray, const Intersection &primaryIts, Sampler &rng) override {
+        assert(m_depth >= 2);
+        if(!m_scene->hasLights()) nee = false;
+        return trace(ray, primaryIts, rng, true, m_cache != nullptr);
+    }
+
+    /**
+     * @brief Iterative path tracing from the vertex @c firstIts that @c ray has found.
+     * @param emitted Whether light emitted at the first vertex is included (cache records only hold reflected light).
+     * @param useCache Whether paths end at their second diffuse vertex where the radiance cache has valid records.
+     */
+    Color trace(const Ray &ray, const Intersection &firstIts, Sampler &rng, bool emitted, bool useCache) {
+        /*
+        incremental update:
+        prev_le <- prev_le + prev_weight * new_le
+        prev_weight <- prev_weight * new_weight
+        */
+        Color prev_weight = Color(1.f);
+        Color prev_le     = Color(0.f);
+        Color new_li      = Color(0.f);
+        Ray   bounceRay   = ray;
+        float bsdfPdf     = Infinity; //density of the bsdf sample that produced bounceRay (camera rays cannot be found by light sampling)
+        int   diffuseVertices = 0;
+
+        while(bounceRay.depth < m_depth){
+            // update ray and its depth
+            // every event check light(nne)            
+            const bool   firstVertex = bounceRay.depth == ray.depth;
+            Intersection its         = firstVertex ? firstIts : m_scene->intersect(bounceRay, rng);
+            if(!its) {
+                // only break when escape the scene
+                new_li = m_scene->evaluateBackground(bounceRay.direction).value;
+                if(new_li != Color(0)) new_li *= bsdfMisWeight(bsdfPdf, m_scene->background(), bounceRay.origin, its);
+                break;
+            } 
+            else{
+                Color new_le      = Color(0.f);
+                Color new_weight  = Color(1.f);
+
+                const bool diffuse = its.instance->bsdf() && its.instance->bsdf()->isDiffuse();
+                if(diffuse) diffuseVertices++;
+                Color cached;
+                if(useCache && diffuse && diffuseVertices == 2 && bounceRay.depth < m_depth-1 &&
+                   m_cache->lookup(its.position, its.frame.normal, bounceRay.depth, &cached)) {
+                    // the records hold all light reflected here, only the emission of the vertex is left to add
+                    if(its.instance->emission())
+                        cached += bsdfMisWeight(bsdfPdf, its.instance->light(), bounceRay.origin, its) * its.evaluateEmission();
+                    return prev_le + prev_weight * cached;
+                }
+
+                if(nee && bounceRay.depth < m_depth-1){
+                    // nne is recognized as a new bounce, for last bounce, nne is not considered
+                    LightSample light_sample = m_scene->sampleLight(its.position, rng);
+
+                    // without mis, lights that can be hit are only found by bsdf sampling
+                    if(m_mis || !light_sample.light->canBeIntersected()) { 
+                        DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
+                        bool              light_its           = direct_light_sample.isInvalid() ||
+                                                                m_scene->intersect( Ray(its.position, direct_light_sample.wi).normalized(),direct_light_sample.distance,rng);
+
+                        if(!light_its)
+                        {
+                            BsdfEval bsdf_eval                = its.evaluateBsdf(direct_light_sample.wi);
+                            float    mis_weight               = m_mis && light_sample.light->canBeIntersected() ?
+                                                                powerHeuristic(light_sample.probability * direct_light_sample.pdf, its.pdfBsdf(direct_light_sample.wi)) : 1.f;
+                                    new_le                  += mis_weight * direct_light_sample.weight * bsdf_eval.value / light_sample.probability;
                         }
                     }
+                }
+
+                if(its.instance->emission() && (emitted || !firstVertex)) //continue tracing
+                    new_le += bsdfMisWeight(bsdfPdf, its.instance->light(), bounceRay.origin, its) * its.evaluateEmission();
+                
+                //sample next ray direction
+                auto sample_result = its.sampleBsdf(rng);
+                new_weight         = sample_result.weight;
+                if(m_mis) {
+                    // dirac bsdfs report a density of zero, their samples can never be found by light sampling
+                    bsdfPdf = its.pdfBsdf(sample_result.wi);
+                    if(bsdfPdf == 0.f) bsdfPdf = Infinity;
+                }
+
+                //incremental update
+                prev_le           += (prev_weight * new_le);
+                prev_weight       *= new_weight;   
 
-                    if(its.instance->emission()) new_le += its.evaluateEmission(); //continue tracing
-                    
-                    //sample next ray direction
-                    auto sample_result = its.sampleBsdf(rng);
-                    new_weight         = sample_result.weight;
+                if(bounceRay.depth >= m_depth-1) break; //no need to update bounceRay, shortcut
 
-                    //incremental update
-                    prev_le           += (prev_weight * new_le);
-                    prev_weight       *= new_weight;   
+                if(bounceRay.depth+1 >= m_rrDepth && !russianRoulette(prev_weight, rng)) break; //terminated paths contribute no further light
 
-                    if(bounceRay.depth >= m_depth-1) break; //no need to update bounceRay, shortcut
+                //update bounceRay for next iteration, depth +1
+                Ray nextRay = Ray(its.position, sample_result.wi, bounceRay.depth+1).normalized();
+                if(its.instance->bsdf() && its.instance->bsdf()->isSpecular()) {
+                    // mirrors and glass carry the footprint on (neglecting the curvature of the surface), other bounces
+                    // scatter it too widely to be tracked and look up textures at their finest resolution
+                    nextRay.width  = its.footprint;
+                    nextRay.spread = bounceRay.spread;
+                }
+                bounceRay = nextRay;
+            }
+        }
+        //initial values: prev_le=0, prev_weight=1, new_li=0
+        return prev_le + prev_weight * new_li;
+    }
 
-                    //update bounceRay for next iteration, depth +1
-                    bounceRay = Ray(its.position, sample_result.wi, bounceRay.depth+1).normalized();             
+    /**
+     * @brief Follows a camera path to its second diffuse vertex (if it is not the last vertex of the path) and
+     * estimates the radius of a cache record there from the harmonic mean distance of a few cosine distributed rays.
+     */
+    std::optional<std::tuple<Ray, Intersection, float>> findCacheVertex(const Ray &ray, Sampler &rng,
+                                                                        float maxRadius) const {
+        static constexpr int RadiusRays = 16;
+        Ray bounceRay = ray;
+        int diffuseVertices = 0;
+        while (bounceRay.depth < m_depth - 1) {
+            const Intersection its = m_scene->intersect(bounceRay, rng);
+            if (!its) return std::nullopt;
+            if (its.instance->bsdf() && its.instance->bsdf()->isDiffuse() && ++diffuseVertices == 2) {
+                float inverseDistanceSum = 0;
+                for (int i = 0; i < RadiusRays; i++) {
+                    const Vector direction = its.frame.toWorld(squareToCosineHemisphere(rng.next2D()));
+                    const Intersection hit = m_scene->intersect(Ray(its.position, direction).normalized(), rng);
+                    if (hit) inverseDistanceSum += 1 / std::max(hit.t, Epsilon);
                 }
+                // records in open surroundings get the largest radius, those in corners are kept from shrinking to nothing
+                const float radius = inverseDistanceSum > 0 ? RadiusRays / inverseDistanceSum : maxRadius;
+                return std::make_tuple(bounceRay, its, clamp(radius, maxRadius / 50, maxRadius));
             }
-            //initial values: prev_le=0, prev_weight=1, new_li=0
-            return prev_le + prev_weight * new_li;
+
+            const BsdfSample sample = its.sampleBsdf(rng);
+            if (sample.isInvalid()) return std::nullopt;
+            bounceRay = Ray(its.position, sample.wi, bounceRay.depth + 1).normalized();
         }
+        return std::nullopt;
     }
 
+    /**
+     * @brief Places cache records where the camera paths of a sparse set of pixels reach their second diffuse vertex,
+     * skipping vertices that existing records already cover, and then estimates the radiance of all records in parallel.
+     */
+    void buildCache() {
+        const float maxRadius = 0.1f * m_scene->getBoundingBox().diagonal().length();
+        m_cache = std::make_unique<RadianceCache>(m_cacheError, maxRadius);
+        if (m_cacheFile && m_cache->load(*m_cacheFile)) {
+            logger(EInfo, "loaded %d radiance cache records from %s", m_cache->size(), *m_cacheFile);
+            return;
+        }
+        if(!m_scene->hasLights()) nee = false;
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        const Vector2i grid((resolution.x() + m_cacheSpacing - 1) / m_cacheSpacing,
+                            (resolution.y() + m_cacheSpacing - 1) / m_cacheSpacing);
+        std::vector<std::optional<std::tuple<Ray, Intersection, float>>> vertices(grid.product());
+        for_each_parallel(ChunkedRange(grid.product(), 256), [&](Range range) {
+            auto sampler = m_sampler->clone();
+            for (int i : range) {
+                const Point2i pixel(std::min((i % grid.x()) * m_cacheSpacing + m_cacheSpacing / 2, resolution.x() - 1),
+                                    std::min((i / grid.x()) * m_cacheSpacing + m_cacheSpacing / 2, resolution.y() - 1));
+                sampler->seed(pixel, 0);
+                vertices[i] = findCacheVertex(m_scene->camera()->sample(pixel, *sampler).ray, *sampler, maxRadius);
+            }
+        });
+
+        // records are placed sequentially, so that each vertex can see whether earlier records already cover it
+        RadianceCache coverage(m_cacheError, maxRadius);
+        std::vector<std::tuple<Ray, Intersection, float>> records;
+        for (const auto &vertex : vertices) {
+            if (!vertex) continue;
+            const auto &[ray, its, radius] = *vertex;
+            if (coverage.lookup(its.position, its.frame.normal, ray.depth)) continue;
+            coverage.insert({ its.position, its.frame.normal, radius, ray.depth, Color(0) });
+            records.push_back(*vertex);
+        }
+
+        std::vector<Color> radiance(records.size());
+        ProgressReporter progress { int(records.size()) };
+        for_each_parallel(ChunkedRange(int(records.size()), 16), [&](Range range) {
+            auto sampler = m_sampler->clone();
+            for (int i : range) {
+                const auto &[ray, its, radius] = records[i];
+                Color sum;
+                for (int sample = 0; sample < m_cacheSamples; sample++) {
+                    // records are seeded like the pixels of a row outside of the image
+                    sampler->seed(Point2i(i, -1), sample);
+                    sum += trace(ray, its, *sampler, false, false);
+                }
+                radiance[i] = sum / m_cacheSamples;
+            }
+            progress += range.count();
+        });
+        progress.finish();
+
+        for (size_t i = 0; i < records.size(); i++) {
+            const auto &[ray, its, radius] = records[i];
+            m_cache->insert({ its.position, its.frame.normal, radius, ray.depth, radiance[i] });
+        }
+        logger(EInfo, "placed %d radiance cache records from %d camera paths, %d samples each", m_cache->size(),
+               grid.product(), m_cacheSamples);
+        if (m_cacheFile) m_cache->save(*m_cacheFile);
+    }
+
+    void execute() override {
+        m_cache.reset();
+        if (m_useCache) buildCache();
+        SamplingIntegrator::execute();
+    }
+
+    bool supportsPacketTracing() const override { return true; }
+
     /// @brief An optional textual representation of this class, which can be useful for debugging. 
     std::string toString() const override {
         return tfm::format(
             "PathTracerIntegrator[\n"
             "  depth = %s,\n"
+            "  rrDepth = %s,\n"
+            "  mis = %s,\n"
+            "  radianceCache = %s,\n"
             "]",
-            indent(m_depth)
+            indent(m_depth),
+            indent(m_rrDepth),
+            m_mis,
+            m_useCache
         );
     }
 };
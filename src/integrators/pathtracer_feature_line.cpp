@@ -1,9 +1,12 @@
 #include <lightwave.hpp>
 
+#include "roulette.hpp"
+
 namespace lightwave {
 
 class PathTracer_Line: public SamplingIntegrator {
     int m_depth;
+    int m_rrDepth;
     bool nee;
 
     float w_screen;      //The line width in screen-space. Notation refers to the paper
@@ -16,6 +19,8 @@ public:
     PathTracer_Line(const Properties &properties)
     : SamplingIntegrator(properties) {
         m_depth  = properties.get<int>("depth", 2);
+        // paths are subject to russian roulette from this depth on (disabled by default)
+        m_rrDepth = properties.get<int>("rrDepth", m_depth);
         nee      = properties.get<bool>("nee", true);
 
         w_screen   = properties.get<float>("wscreen", 0.2f);  //this, combined with the pixel width in instance, determines the line width in screen-space. Notation refers to the paper
@@ -32,7 +37,7 @@ public:
 
     bool isLine_Metric(const Intersection &sample_its, const Intersection &target_its, const Color &target_albedo, Sampler &rng){
         if (sample_its.instance->id() != target_its.instance->id())                                return true;  //check if the sample point is on the same object
-        else if(target_its.instance->getAlbedo() && (sample_its.sampleBsdf(rng).weight - target_albedo).lengthSquared() > tao_albedo ) return true; //check if the sample point is on the same material/ color region, take the square as metric for saving computation cost
+        else if(target_its.instance->getAlbedo() && (sample_its.albedoBsdf() - target_albedo).lengthSquared() > tao_albedo ) return true; //check if the sample point is on the same material/ color region, take the square as metric for saving computation cost
         else if(target_its.instance->getNormal() && (1.f - abs(sample_its.frame.normal.dot(target_its.frame.normal))) > tao_normal)    return true; //check if the sample point is on the same surface, take the square as metric for saving computation cost
         // else { //check if the sample point is on similar depth, equation refers to the paper
         //     if (sample_its.t < target_its.t) {
@@ -61,7 +66,7 @@ public:
         prev_w_scaled  = w_scaled;
 
         //for saving computation cost, later we only compute the albedo of the sample point
-        Color target_albedo = target_its.sampleBsdf(rng).weight;
+        Color target_albedo = target_its.albedoBsdf();
         
         for(int i = 0; i < line_samplecount; i++){
             //generate a random point on the tangent plane
@@ -126,7 +131,7 @@ public:
 
                     if(nee && bounceRay.depth < m_depth-1){
                         // nne is recognized as a new bounce, for last bounce, nne is not considered
-                        LightSample light_sample = m_scene->sampleLight(rng);
+                        LightSample light_sample = m_scene->sampleLight(its.position, rng);
 
                         if(!light_sample.light->canBeIntersected()) { 
                             DirectLightSample direct_light_sample = light_sample.light->sampleDirect(its.position, rng);
@@ -152,6 +157,8 @@ public:
 
                     if(bounceRay.depth >= m_depth-1) break; //no need to update bounceRay, shortcut
 
+                    if(bounceRay.depth+1 >= m_rrDepth && !russianRoulette(prev_weight, rng)) break; //terminated paths contribute no further light
+
                     //update bounceRay for next iteration, depth +1
                     bounceRay = Ray(its.position, sample_result.wi, bounceRay.depth+1).normalized();             
                 }
@@ -166,8 +173,10 @@ public:
         return tfm::format(
             "PathTracerIntegrator[\n"
             "  depth = %s,\n"
+            "  rrDepth = %s,\n"
             "]",
-            indent(m_depth)
+            indent(m_depth),
+            indent(m_rrDepth)
         );
     }
 };
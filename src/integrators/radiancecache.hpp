@@ -0,0 +1,163 @@
+/**
+ * @brief A world space cache of the radiance reflected by diffuse surfaces, in the spirit of irradiance caching
+ * [Ward et al. 1988]: sparse records are interpolated with weights that grow with proximity and similarity of normals.
+ * @file radiancecache.hpp
+ */
+
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/logger.hpp>
+#include <lightwave/math.hpp>
+
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_map>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Records of reflected radiance, stored in a hash grid over space. Each record is inserted into all cells that
+ * its region of influence overlaps, so that lookups only visit the records of a single cell.
+ * @note Lookups are thread-safe, but must not run concurrently with @ref insert or @ref load .
+ */
+class RadianceCache {
+public:
+    struct Record {
+        Point position;
+        Vector normal;
+        /// @brief The harmonic mean distance to the surrounding geometry, which limits the validity of the record.
+        float radius;
+        /// @brief The depth of the path vertex the record stands for, as this bounds the remaining number of bounces.
+        int depth;
+        /// @brief The radiance reflected by the surface (which does not depend on the outgoing direction).
+        Color radiance;
+    };
+
+private:
+    /// @brief The largest error (see @ref error ) with which records are still used.
+    float m_maxError;
+    float m_cellSize;
+    std::vector<Record> m_records;
+    std::unordered_map<uint64_t, std::vector<uint32_t>> m_cells;
+
+    struct FileHeader {
+        char magic[4] = { 'l', 'w', 'r', 'c' };
+        uint32_t version = 1;
+        uint32_t recordSize = sizeof(Record);
+        uint32_t count = 0;
+    };
+
+    Vector3i cell(const Point &position) const {
+        return Vector3i(int(std::floor(position.x() / m_cellSize)), int(std::floor(position.y() / m_cellSize)),
+                    int(std::floor(position.z() / m_cellSize)));
+    }
+
+    static uint64_t key(const Vector3i &cell) {
+        // 21 bits per axis are plenty for any reasonable ratio of scene size to cell size
+        const auto bits = [](int v) { return uint64_t(uint32_t(v) & 0x1fffff); };
+        return bits(cell.x()) | bits(cell.y()) << 21 | bits(cell.z()) << 42;
+    }
+
+    /// @brief Ward's error estimate of reusing a record at a given point, relative to the validity of the record.
+    static float error(const Record &record, const Point &position, const Vector &normal) {
+        return (position - record.position).length() / record.radius +
+               safe_sqrt(1 - std::min(normal.dot(record.normal), 1.f));
+    }
+
+    void index(uint32_t recordIndex) {
+        const Record &record = m_records[recordIndex];
+        const Vector extent(m_maxError * record.radius);
+        const Vector3i lower = cell(record.position - extent);
+        const Vector3i upper = cell(record.position + extent);
+        for (int z = lower.z(); z <= upper.z(); z++) {
+            for (int y = lower.y(); y <= upper.y(); y++) {
+                for (int x = lower.x(); x <= upper.x(); x++) {
+                    m_cells[key(Vector3i(x, y, z))].push_back(recordIndex);
+                }
+            }
+        }
+    }
+
+public:
+    /**
+     * @param maxError The largest error with which records are still used (Ward's "a", where a record influences
+     * points within this fraction of its radius).
+     * @param maxRadius The largest radius of any record, which determines the size of the cells.
+     */
+    RadianceCache(float maxError, float maxRadius)
+    : m_maxError(maxError), m_cellSize(std::max(maxError * maxRadius, Epsilon)) {}
+
+    /// @brief The number of records in the cache.
+    int size() const { return int(m_records.size()); }
+
+    void insert(const Record &record) {
+        m_records.push_back(record);
+        index(uint32_t(m_records.size() - 1));
+    }
+
+    /**
+     * @brief Interpolates the radiance of the records that are valid at a given point, whose weights are the inverse
+     * of their error. Records in front of the point (which might see geometry the point does not) are skipped.
+     * @return Whether any record is valid at the point (otherwise, @c radiance is left unchanged).
+     */
+    bool lookup(const Point &position, const Vector &normal, int depth, Color *radiance = nullptr) const {
+        const auto it = m_cells.find(key(cell(position)));
+        if (it == m_cells.end()) return false;
+
+        Color sum;
+        float weightSum = 0;
+        for (uint32_t recordIndex : it->second) {
+            const Record &record = m_records[recordIndex];
+            if (record.depth != depth) continue;
+            const float recordError = error(record, position, normal);
+            if (recordError >= m_maxError) continue;
+            const float inFront = (position - record.position).dot(normal + record.normal);
+            if (inFront < -0.05f * record.radius) continue;
+
+            const float weight = 1 / std::max(recordError, Epsilon);
+            sum += weight * record.radiance;
+            weightSum += weight;
+        }
+        if (!(weightSum > 0)) return false;
+        if (radiance) *radiance = sum / weightSum;
+        return true;
+    }
+
+    /// @brief Writes all records to a file, which allows reusing the cache when rendering another frame of a static scene.
+    void save(const std::filesystem::path &path) const {
+        FileHeader header;
+        header.count = uint32_t(m_records.size());
+        std::ofstream file(path, std::ios::binary);
+        file.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        file.write(reinterpret_cast<const char *>(m_records.data()), m_records.size() * sizeof(Record));
+        if (!file) {
+            logger(EError, "could not write radiance cache %s", path);
+        }
+    }
+
+    /// @brief Adds all records from a file written by @ref save , returning false if the file does not exist.
+    bool load(const std::filesystem::path &path) {
+        std::ifstream file(path, std::ios::binary);
+        if (!file) return false;
+
+        FileHeader expected, header;
+        file.read(reinterpret_cast<char *>(&header), sizeof(header));
+        if (!file || std::memcmp(header.magic, expected.magic, sizeof(header.magic)) != 0 ||
+            header.version != expected.version || header.recordSize != expected.recordSize) {
+            lightwave_throw("%s is not a valid radiance cache", path);
+        }
+
+        std::vector<Record> records(header.count);
+        file.read(reinterpret_cast<char *>(records.data()), records.size() * sizeof(Record));
+        if (!file) {
+            lightwave_throw("radiance cache %s is truncated", path);
+        }
+        for (const Record &record : records) insert(record);
+        return true;
+    }
+};
+
+}
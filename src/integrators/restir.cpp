@@ -0,0 +1,404 @@
+#include <lightwave.hpp>
+
+#include <array>
+
+namespace lightwave {
+
+/**
+ * @brief Renders direct illumination using reservoir-based spatiotemporal importance resampling, as described in
+ * "Spatiotemporal reservoir resampling for real-time ray tracing with dynamic direct lighting" [Bitterli et al. 2020].
+ * Each pixel first resamples a single light sample from many cheap candidates (without testing their visibility), and
+ * then reuses the reservoirs of nearby pixels and of its previous sample, so that only the final choice needs a shadow ray.
+ * @note Samples are rendered one after another for all pixels, so that reservoirs of neighboring pixels are available.
+ * Reuse is weighted with the balance heuristic over the target functions of all pixels involved, so the result converges
+ * to the same image as direct lighting via next event estimation. Since samples are averaged rather than displayed one
+ * by one, temporal reuse only correlates them and is disabled by default. Lights can only be reached via light
+ * sampling, which means that perfectly specular surfaces receive no direct illumination.
+ */
+class RestirIntegrator : public SamplingIntegrator {
+    /// @brief The maximum number of neighbors that can be considered for spatial reuse.
+    static constexpr int MaxSpatialSamples = 16;
+
+    /// @brief A sampled point on a light source, stored so that it can be connected to from other shading points.
+    struct LightPoint {
+        enum Type {
+            /// @brief A point on an emitting surface (integrated with respect to area).
+            Area,
+            /// @brief A point light (integrated with respect to the counting measure).
+            Positional,
+            /// @brief A direction towards a background light (integrated with respect to solid angle).
+            Distant,
+            /// @brief The direction of a directional light (integrated with respect to the counting measure).
+            Directional,
+        };
+
+        Type type = Area;
+        /// @brief The position of the light point (for area and point lights), or the direction towards it.
+        Vector position;
+        /// @brief The normal of area light points, oriented towards the shading point the sample was created for.
+        Vector normal;
+        /// @brief The emitted radiance (area and background lights) or intensity (point lights), or the irradiance
+        /// (directional lights).
+        Color emission;
+    };
+
+    /// @brief The incident illumination that a light point provides to a shading point (neglecting visibility).
+    struct Connection {
+        Vector wi;
+        float distance;
+        /// @brief The emission of the light point, scaled by the geometry term of the measure it is integrated over.
+        Color radiance;
+    };
+
+    /// @brief A reservoir that streams over weighted light points and keeps one of them.
+    struct Reservoir {
+        LightPoint sample;
+        /// @brief The sum of resampling weights of all candidates seen so far.
+        float weightSum = 0;
+        /// @brief The number of candidates seen so far (including those inherited through reuse).
+        float count = 0;
+        /// @brief The unbiased contribution weight of the chosen sample, i.e., an estimate of its reciprocal density.
+        float contributionWeight = 0;
+        /// @brief The target function of the pixel that owns this reservoir, evaluated for the chosen sample.
+        float targetValue = 0;
+
+        /// @brief Streams a candidate into the reservoir, returning whether it replaced the chosen sample.
+        bool update(const LightPoint &candidate, float weight, float candidateCount, float rnd) {
+            weightSum += weight;
+            count += candidateCount;
+            if (!(weight > 0) || rnd * weightSum >= weight) return false;
+            sample = candidate;
+            return true;
+        }
+    };
+
+    /// @brief The primary hit point of a pixel for the current sample.
+    struct PixelState {
+        /// @brief The intersection found by the camera ray (invalid if the ray escaped the scene).
+        Intersection its;
+        /// @brief The weight of the camera sample.
+        Color cameraWeight;
+        /// @brief Radiance that reaches the camera directly (from emitters or the background).
+        Color emitted;
+
+        bool canReceiveLight() const { return its && its.instance->bsdf(); }
+    };
+
+    /// @brief The number of light samples that are resampled to find the initial sample of each pixel.
+    int m_candidates;
+    /// @brief The number of neighboring pixels whose reservoirs are reused.
+    int m_spatialSamples;
+    /// @brief The radius (in pixels) in which neighboring pixels are picked for reuse.
+    float m_spatialRadius;
+    /// @brief Whether the reservoirs of the previous sample of a pixel are reused.
+    bool m_temporal;
+    /// @brief The maximum number of candidates a temporal reservoir can contribute, relative to @ref m_candidates ,
+    /// which prevents the history from dominating new samples.
+    float m_temporalHistory;
+
+    /// @brief Converts a sample of @ref Light::sampleDirect into a light point that can be reused by other shading points.
+    static LightPoint makeLightPoint(const Point &origin, const DirectLightSample &sample) {
+        LightPoint result;
+        if (sample.distance == Infinity) {
+            result.position = sample.wi;
+            if (sample.pdf == Infinity) {
+                result.type = LightPoint::Directional;
+                result.emission = sample.weight;
+            } else {
+                result.type = LightPoint::Distant;
+                result.emission = sample.weight * sample.pdf;
+            }
+        } else {
+            result.position = Vector(origin + sample.wi * sample.distance);
+            if (sample.pdf == Infinity) {
+                result.type = LightPoint::Positional;
+                result.emission = sample.weight * sqr(sample.distance);
+            } else {
+                result.type = LightPoint::Area;
+                result.normal = sample.normal.dot(sample.wi) > 0 ? -sample.normal : sample.normal;
+                result.emission = sample.weight * sample.pdf;
+            }
+        }
+        return result;
+    }
+
+    /// @brief Determines the illumination a light point provides to a shading point, returning false if it provides none.
+    static bool connect(const LightPoint &light, const Point &origin, Connection &connection) {
+        switch (light.type) {
+        case LightPoint::Distant:
+        case LightPoint::Directional:
+            connection.wi = light.position;
+            connection.distance = Infinity;
+            connection.radiance = light.emission;
+            return true;
+        default:
+            break;
+        }
+
+        connection.wi = Point(light.position) - origin;
+        const float distanceSquared = connection.wi.lengthSquared();
+        if (!(distanceSquared > 0)) return false;
+        connection.distance = std::sqrt(distanceSquared);
+        connection.wi /= connection.distance;
+
+        if (light.type == LightPoint::Positional) {
+            connection.radiance = light.emission / distanceSquared;
+            return true;
+        }
+
+        // area lights emit only to the side of their surface that faced the shading point of the original sample
+        const float cosLight = -light.normal.dot(connection.wi);
+        if (cosLight <= 0) return false;
+        connection.radiance = light.emission * (cosLight / distanceSquared);
+        return true;
+    }
+
+    /// @brief The target function that reservoirs resample proportionally to, i.e., the unshadowed contribution of a light point.
+    static float targetFunction(const PixelState &state, const LightPoint &light) {
+        Connection connection;
+        if (!connect(light, state.its.position, connection)) return 0;
+        return std::max(0.f, (state.its.evaluateBsdf(connection.wi).value * connection.radiance).luminance());
+    }
+
+    /// @brief Computes the contribution weight of the chosen sample once all candidates have been streamed through.
+    static void finalize(Reservoir &reservoir, float targetValue, float normalization) {
+        reservoir.targetValue = targetValue;
+        reservoir.contributionWeight =
+            targetValue > 0 && normalization > 0 ? reservoir.weightSum / (normalization * targetValue) : 0;
+    }
+
+    /// @brief Resamples the initial reservoir of a pixel from light samples.
+    Reservoir sampleCandidates(const PixelState &state, Sampler &rng) const {
+        Reservoir reservoir;
+        for (int i = 0; i < m_candidates; i++) {
+            const LightSample lightSample = m_scene->sampleLight(state.its.position, rng);
+            const DirectLightSample sample = lightSample.light->sampleDirect(state.its.position, rng);
+            const float rnd = rng.next();
+            if (sample.isInvalid() || !(lightSample.probability > 0)) {
+                reservoir.update({}, 0, 1, rnd);
+                continue;
+            }
+
+            // the resampling weight is the target function over the source density; both include the same geometry
+            // term, which allows us to compute the ratio directly from the weight of the sample
+            const Color contribution = state.its.evaluateBsdf(sample.wi).value * sample.weight;
+            const float weight = std::max(0.f, contribution.luminance()) / lightSample.probability;
+            reservoir.update(makeLightPoint(state.its.position, sample), weight, 1, rnd);
+        }
+
+        finalize(reservoir, reservoir.weightSum > 0 ? targetFunction(state, reservoir.sample) : 0, reservoir.count);
+        return reservoir;
+    }
+
+    /// @brief The reservoir of another pixel (or of the previous sample), together with the pixel it belongs to.
+    struct ReuseCandidate {
+        const Reservoir *reservoir;
+        const PixelState *state;
+    };
+
+    /**
+     * @brief Combines the reservoir of a pixel with the reservoirs of other pixels into a new reservoir for that pixel.
+     * Samples are weighted with pairwise multiple importance sampling [Bitterli 2022], which compares the target
+     * function of each other pixel only with that of the (canonical) pixel itself. This keeps the combination unbiased
+     * even though the pixels resample with different target functions, and needs a linear number of evaluations of the
+     * target function instead of the quadratic number of the balance heuristic over all pixels.
+     */
+    template <size_t N>
+    static Reservoir combine(const PixelState &state, const Reservoir &canonical,
+                             const std::array<ReuseCandidate, N> &others, int count, Sampler &rng) {
+        if (count == 0) return canonical;
+
+        Reservoir result;
+        float targetValue = 0;
+        // the canonical sample accumulates the share of its weight that each pair leaves to it
+        float canonicalWeight = 0;
+        for (int i = 0; i < count; i++) {
+            const Reservoir &other = *others[i].reservoir;
+            const float otherCount = other.count;
+            const float canonicalCount = canonical.count / count;
+
+            // the canonical sample as seen by the other pixel
+            if (canonical.contributionWeight > 0) {
+                const float denominator = canonicalCount * canonical.targetValue +
+                                          otherCount * targetFunction(*others[i].state, canonical.sample);
+                canonicalWeight += canonicalCount * canonical.targetValue / denominator;
+            }
+
+            // the sample of the other pixel as seen by the canonical pixel
+            const float value = other.contributionWeight > 0 ? targetFunction(state, other.sample) : 0;
+            float weight = 0;
+            if (value > 0) {
+                const float mis = otherCount * other.targetValue /
+                                  (otherCount * other.targetValue + canonicalCount * value) / count;
+                weight = mis * value * other.contributionWeight;
+            }
+            if (result.update(other.sample, weight, otherCount, rng.next())) targetValue = value;
+        }
+
+        const float weight = canonicalWeight / count * canonical.targetValue * canonical.contributionWeight;
+        if (result.update(canonical.sample, weight, canonical.count, rng.next())) targetValue = canonical.targetValue;
+        finalize(result, targetValue, 1);
+        return result;
+    }
+
+    /// @brief Reports whether the geometry of two pixels is similar enough to share light samples.
+    static bool isSimilar(const PixelState &a, const PixelState &b) {
+        if (!b.canReceiveLight()) return false;
+        if (a.its.frame.normal.dot(b.its.frame.normal) < 0.9f) return false;
+        return std::abs(a.its.t - b.its.t) <= 0.1f * a.its.t;
+    }
+
+public:
+    RestirIntegrator(const Properties &properties)
+    : SamplingIntegrator(properties) {
+        // with spatial reuse, a few candidates per pixel are more efficient than many
+        m_candidates = properties.get<int>("candidates", 4);
+        m_spatialSamples = properties.get<int>("spatialSamples", 5);
+        m_spatialRadius = properties.get<float>("spatialRadius", 30);
+        m_temporal = properties.get<bool>("temporal", false);
+        m_temporalHistory = properties.get<float>("temporalHistory", 20);
+        if (m_candidates < 1) {
+            lightwave_throw("candidates must be at least 1, but is %d", m_candidates);
+        }
+        if (m_spatialSamples < 0 || m_spatialSamples > MaxSpatialSamples) {
+            lightwave_throw("spatialSamples must lie between 0 and %d, but is %d", MaxSpatialSamples, m_spatialSamples);
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        NOT_IMPLEMENTED
+    }
+
+    void execute() override {
+        if (!m_image) {
+            lightwave_throw("<integrator /> needs an <image /> child to render into!");
+        }
+        if (m_adaptive || m_progressive || options.isPartialRender()) {
+            logger(EWarn, "reservoir resampling renders all samples of the image at once, ignoring progressive, "
+                          "adaptive and partial rendering");
+        }
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_image->initialize(resolution);
+        Streaming stream { *m_image };
+
+        const int spp = m_sampler->samplesPerPixel();
+        const auto index = [&](const Point2i &pixel) { return pixel.y() * resolution.x() + pixel.x(); };
+        std::vector<PixelState> states(resolution.product()), previousStates(resolution.product());
+        std::vector<Reservoir> initial(resolution.product()), reservoirs(resolution.product());
+        std::vector<Color> sums(resolution.product());
+
+        ProgressReporter progress { spp * resolution.product() };
+        for (int sample = 0; sample < spp; sample++) {
+            const bool temporal = m_temporal && sample > 0;
+            std::swap(states, previousStates);
+
+            // find the primary hit points and resample their initial light samples
+            for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+                auto sampler = m_sampler->clone();
+                for (auto pixel : block) {
+                    const int i = index(pixel);
+                    sampler->seed(pixel, sample);
+                    const auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+
+                    PixelState &state = states[i];
+                    state.its = m_scene->intersect(cameraSample.ray, *sampler);
+                    state.cameraWeight = cameraSample.weight;
+                    state.emitted = state.its ? state.its.evaluateEmission()
+                                              : m_scene->evaluateBackground(cameraSample.ray.direction).value;
+                    if (!state.canReceiveLight() || !m_scene->hasLights()) {
+                        initial[i] = {};
+                        continue;
+                    }
+
+                    initial[i] = sampleCandidates(state, *sampler);
+                    if (temporal && isSimilar(state, previousStates[i])) {
+                        Reservoir history = reservoirs[i];
+                        history.count = std::min(history.count, m_temporalHistory * m_candidates);
+                        const std::array<ReuseCandidate, 1> others { { { &history, &previousStates[i] } } };
+                        initial[i] = combine(state, initial[i], others, 1, *sampler);
+                    }
+                }
+            });
+
+            // reuse the reservoirs of nearby pixels and shade with the final choice
+            for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+                auto sampler = m_sampler->clone();
+                for (auto pixel : block) {
+                    const int i = index(pixel);
+                    // use other random numbers than the camera sample of this pixel
+                    sampler->seed(pixel, spp + sample);
+
+                    const PixelState &state = states[i];
+                    Color contribution = state.emitted;
+                    if (!state.canReceiveLight() || !m_scene->hasLights()) {
+                        reservoirs[i] = {};
+                        sums[i] += state.cameraWeight * contribution;
+                        continue;
+                    }
+
+                    std::array<ReuseCandidate, MaxSpatialSamples> others;
+                    int count = 0;
+                    for (int k = 0; k < m_spatialSamples; k++) {
+                        const Point2 offset = squareToUniformDiskConcentric(sampler->next2D());
+                        const Point2i neighbor {
+                            pixel.x() + int(std::round(offset.x() * m_spatialRadius)),
+                            pixel.y() + int(std::round(offset.y() * m_spatialRadius)),
+                        };
+                        if (neighbor == pixel || neighbor.x() < 0 || neighbor.y() < 0 ||
+                            neighbor.x() >= resolution.x() || neighbor.y() >= resolution.y())
+                            continue;
+                        const int j = index(neighbor);
+                        if (!isSimilar(state, states[j])) continue;
+                        others[count++] = { &initial[j], &states[j] };
+                    }
+
+                    const Reservoir reservoir = combine(state, initial[i], others, count, *sampler);
+                    reservoirs[i] = reservoir;
+
+                    Connection connection;
+                    if (reservoir.contributionWeight > 0 &&
+                        connect(reservoir.sample, state.its.position, connection) &&
+                        !m_scene->intersect(Ray(state.its.position, connection.wi), connection.distance, *sampler)) {
+                        contribution += state.its.evaluateBsdf(connection.wi).value * connection.radiance *
+                                        reservoir.contributionWeight;
+                    }
+                    sums[i] += state.cameraWeight * contribution;
+                }
+            });
+
+            const float norm = 1.0f / (sample + 1);
+            for (auto pixel : m_image->bounds()) {
+                m_image->get(pixel) = norm * sums[index(pixel)];
+            }
+            stream.update();
+            progress += resolution.product();
+        }
+        progress.finish();
+
+        m_image->save();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "RestirIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  candidates = %d,\n"
+            "  spatialSamples = %d,\n"
+            "  spatialRadius = %f,\n"
+            "  temporal = %s,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_candidates,
+            m_spatialSamples,
+            m_spatialRadius,
+            m_temporal ? "true" : "false"
+        );
+    }
+};
+
+}
+
+REGISTER_INTEGRATOR(RestirIntegrator, "restir")
@@ -0,0 +1,31 @@
+/**
+ * @brief Russian roulette path termination, shared by the path tracing integrators.
+ * @file roulette.hpp
+ */
+
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/sampler.hpp>
+
+namespace lightwave {
+
+/// @brief The survival probability is capped so that even bright paths are terminated eventually.
+static constexpr float MaxSurvivalProbability = 0.95f;
+
+/**
+ * @brief Randomly terminates paths with low throughput, with a survival probability proportional to
+ * the largest channel of the throughput. Surviving paths are reweighted by the inverse survival
+ * probability, which keeps the estimator unbiased.
+ * @param throughput The product of all bsdf weights along the path, which is updated in place.
+ * @return Whether the path survived and should continue to be traced.
+ */
+inline bool russianRoulette(Color &throughput, Sampler &rng) {
+    const float survival = std::min(
+        std::max({ throughput.r(), throughput.g(), throughput.b() }), MaxSurvivalProbability);
+    if (!(survival > 0) || rng.next() >= survival) return false;
+    throughput /= survival;
+    return true;
+}
+
+}
@@ -0,0 +1,237 @@
+/**
+ * @brief The spatio-directional tree of "Practical Path Guiding for Efficient Light-Transport Simulation"
+ * [Müller et al. 2017], which learns the distribution of incident radiance throughout the scene while rendering.
+ * @file sdtree.hpp
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+#include <lightwave/sampler.hpp>
+#include <lightwave/warp.hpp>
+
+#include "spatialtree.hpp"
+
+#include <array>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief A quadtree over the sphere of directions, which records radiance and samples directions in proportion to it.
+ * Directions are mapped to the unit square through world space cylindrical coordinates (cosine of the polar angle and
+ * azimuth), which preserves area, so that the density of a cell is uniform in solid angle.
+ * @note Recording is thread-safe. The structure of the tree only changes through @ref refine , which must not run
+ * concurrently with recording or sampling.
+ */
+class DirectionalTree {
+    /// @brief Cells are not subdivided further than this, which also keeps the remapped random numbers precise enough.
+    static constexpr int MaxDepth = 20;
+
+    struct Node {
+        /// @brief The radiance recorded in each quadrant (ordered as x + 2y).
+        std::array<AtomicFloat, 4> sums;
+        /// @brief The node of each quadrant, or 0 if the quadrant is a leaf (the root can never be a child).
+        std::array<uint32_t, 4> children {};
+
+        float total() const { return sums[0].get() + sums[1].get() + sums[2].get() + sums[3].get(); }
+    };
+
+    std::vector<Node> m_nodes;
+    /// @brief The number of samples recorded since the last reset.
+    AtomicFloat m_sampleCount;
+
+    /// @brief Picks the quadrant that contains a point, and remaps the point into the quadrant.
+    static int quadrant(Point2 &point) {
+        const int x = point.x() >= 0.5f;
+        const int y = point.y() >= 0.5f;
+        point = Point2(std::min(2 * point.x() - x, 1 - Epsilon), std::min(2 * point.y() - y, 1 - Epsilon));
+        return x + 2 * y;
+    }
+
+    static Point2 directionToSquare(const Vector &direction) {
+        const float cosTheta = clamp(direction.z(), -1.f, 1.f);
+        float phi = std::atan2(direction.y(), direction.x());
+        if (phi < 0) phi += 2 * Pi;
+        return Point2(std::min((cosTheta + 1) / 2, 1 - Epsilon), std::min(phi * Inv2Pi, 1 - Epsilon));
+    }
+
+    static Vector squareToDirection(const Point2 &point) {
+        const float cosTheta = 2 * point.x() - 1;
+        const float sinTheta = safe_sqrt(1 - sqr(cosTheta));
+        const float phi = 2 * Pi * point.y();
+        return Vector(sinTheta * std::cos(phi), sinTheta * std::sin(phi), cosTheta);
+    }
+
+public:
+    DirectionalTree() : m_nodes(1) {}
+
+    /// @brief The total radiance recorded in the tree.
+    float total() const { return m_nodes[0].total(); }
+    /// @brief The number of samples recorded since the last reset.
+    float sampleCount() const { return m_sampleCount.get(); }
+    /// @brief The number of nodes of the tree.
+    int nodeCount() const { return int(m_nodes.size()); }
+
+    /// @brief Scales the recorded radiance and sample count, e.g., to split them between two spatial cells.
+    void scale(float factor) {
+        for (Node &node : m_nodes) {
+            for (AtomicFloat &sum : node.sums) sum = AtomicFloat(sum.get() * factor);
+        }
+        m_sampleCount = AtomicFloat(m_sampleCount.get() * factor);
+    }
+
+    /// @brief Records a radiance estimate (divided by the density of the direction it was sampled from).
+    void record(const Vector &direction, float value) {
+        m_sampleCount.add(1);
+        if (!(value > 0) || !std::isfinite(value)) return;
+
+        Point2 point = directionToSquare(direction);
+        uint32_t index = 0;
+        while (true) {
+            const int child = quadrant(point);
+            m_nodes[index].sums[child].add(value);
+            if (!m_nodes[index].children[child]) break;
+            index = m_nodes[index].children[child];
+        }
+    }
+
+    /// @brief Samples a direction in proportion to the recorded radiance (must not be called if @ref total is zero).
+    Vector sample(const Point2 &rnd) const {
+        Point2 sample = rnd;
+        Point2 origin(0, 0);
+        float size = 1;
+        uint32_t index = 0;
+        while (true) {
+            const Node &node = m_nodes[index];
+            // pick the column first, then the row within the column
+            const float left = node.sums[0].get() + node.sums[2].get();
+            const float total = left + node.sums[1].get() + node.sums[3].get();
+            int x = 0;
+            float leftFraction = left / total;
+            if (sample.x() < leftFraction) {
+                sample.x() = sample.x() / leftFraction;
+            } else {
+                x = 1;
+                sample.x() = (sample.x() - leftFraction) / (1 - leftFraction);
+            }
+            const float column = node.sums[x].get() + node.sums[x + 2].get();
+            const float bottomFraction = node.sums[x].get() / column;
+            int y = 0;
+            if (sample.y() < bottomFraction) {
+                sample.y() = sample.y() / bottomFraction;
+            } else {
+                y = 1;
+                sample.y() = (sample.y() - bottomFraction) / (1 - bottomFraction);
+            }
+            sample = Point2(std::min(sample.x(), 1 - Epsilon), std::min(sample.y(), 1 - Epsilon));
+
+            size /= 2;
+            origin = Point2(origin.x() + x * size, origin.y() + y * size);
+            const int child = x + 2 * y;
+            if (!node.children[child]) break;
+            index = node.children[child];
+        }
+        return squareToDirection(Point2(origin.x() + sample.x() * size, origin.y() + sample.y() * size));
+    }
+
+    /// @brief Returns the solid angle density of @ref sample producing a given direction.
+    float pdf(const Vector &direction) const {
+        const float rootTotal = total();
+        if (!(rootTotal > 0)) return 0;
+
+        Point2 point = directionToSquare(direction);
+        float density = Inv4Pi;
+        uint32_t index = 0;
+        float nodeTotal = rootTotal;
+        while (true) {
+            const int child = quadrant(point);
+            const float childSum = m_nodes[index].sums[child].get();
+            if (!(childSum > 0)) return 0;
+            density *= 4 * childSum / nodeTotal;
+            if (!m_nodes[index].children[child]) break;
+            index = m_nodes[index].children[child];
+            nodeTotal = childSum;
+        }
+        return density;
+    }
+
+    /**
+     * @brief Replaces this tree with an empty tree whose cells are subdivided wherever a cell of @c energy holds more
+     * than a fraction @c threshold of its total radiance, and merged wherever they hold less.
+     */
+    void refine(const DirectionalTree &energy, float threshold) {
+        m_nodes.assign(1, Node());
+        m_sampleCount = AtomicFloat(0);
+        const float rootTotal = energy.total();
+        if (!(rootTotal > 0)) return;
+
+        struct Entry {
+            uint32_t node;
+            /// @brief The corresponding node of the energy tree, or -1 if the energy is only known for the whole cell.
+            int energyNode;
+            /// @brief The energy of the cell, used for all four quadrants if the node has no counterpart in @c energy .
+            float energy;
+            int depth;
+        };
+        std::vector<Entry> stack { { 0, 0, rootTotal, 1 } };
+        while (!stack.empty()) {
+            const Entry entry = stack.back();
+            stack.pop_back();
+            for (int child = 0; child < 4; child++) {
+                const Node *energyNode = entry.energyNode >= 0 ? &energy.m_nodes[entry.energyNode] : nullptr;
+                const float childEnergy = energyNode ? energyNode->sums[child].get() : entry.energy / 4;
+                if (entry.depth >= MaxDepth || childEnergy <= threshold * rootTotal) continue;
+
+                const uint32_t index = uint32_t(m_nodes.size());
+                m_nodes.emplace_back();
+                m_nodes[entry.node].children[child] = index;
+                const int energyChild = energyNode && energyNode->children[child] ? int(energyNode->children[child]) : -1;
+                stack.push_back({ index, energyChild, childEnergy, entry.depth + 1 });
+            }
+        }
+    }
+};
+
+/**
+ * @brief A binary tree over space whose leaves hold directional trees, refined between training passes.
+ * Each leaf holds a tree that is sampled from (learned in previous passes) and a tree that records the current pass.
+ */
+class SDTree {
+public:
+    struct Leaf {
+        /// @brief The distribution learned in the previous pass, used for sampling.
+        DirectionalTree sampling;
+        /// @brief The distribution recorded in the current pass.
+        DirectionalTree building;
+    };
+
+private:
+    SpatialTree<Leaf> m_tree;
+
+public:
+    SDTree(const Bounds &bounds) : m_tree(bounds) {}
+
+    /// @brief Finds the leaf whose cell contains the given point.
+    Leaf &lookup(const Point &position) { return m_tree.lookup(position); }
+    /// @brief The number of leaves of the spatial tree.
+    int leafCount() const { return m_tree.leafCount(); }
+
+    /**
+     * @brief Splits cells that have recorded more than @c spatialThreshold samples, and then turns the recorded
+     * distributions into the sampling distributions of the next pass (refining the directional trees that record it).
+     */
+    void refine(float spatialThreshold, float directionalThreshold) {
+        m_tree.subdivide(
+            [&](const Leaf &leaf) { return leaf.building.sampleCount() > spatialThreshold; },
+            // both halves start out with the distribution of the whole cell, and split further if needed
+            [](Leaf &leaf) { leaf.building.scale(0.5f); });
+
+        m_tree.forEachLeaf([&](Leaf &leaf) {
+            leaf.sampling = leaf.building;
+            leaf.building.refine(leaf.sampling, directionalThreshold);
+        });
+    }
+};
+
+}
@@ -0,0 +1,123 @@
+/**
+ * @brief A binary tree that partitions space into cells holding statistics learned while rendering, shared by the
+ * integrators that adapt their sampling decisions to the scene.
+ * @file spatialtree.hpp
+ */
+
+#pragma once
+
+#include <lightwave/math.hpp>
+
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <utility>
+#include <vector>
+
+namespace lightwave {
+
+/// @brief A float that several threads can accumulate into at once (and that, unlike @c std::atomic , can be copied).
+class AtomicFloat {
+    std::atomic<float> m_value;
+
+public:
+    AtomicFloat(float value = 0) : m_value(value) {}
+    AtomicFloat(const AtomicFloat &other) : m_value(other.get()) {}
+    AtomicFloat &operator=(const AtomicFloat &other) {
+        m_value.store(other.get(), std::memory_order_relaxed);
+        return *this;
+    }
+
+    float get() const { return m_value.load(std::memory_order_relaxed); }
+    void add(float value) { m_value.fetch_add(value, std::memory_order_relaxed); }
+};
+
+/**
+ * @brief A binary tree over space, whose leaves hold the data of type @c Leaf for their cell. Cells are split in half
+ * along an axis that cycles with depth, starting from a cube that encloses the given bounds.
+ * @note Leaves can be looked up (and their data updated) concurrently, but the structure of the tree only changes
+ * through @ref subdivide , which must not run concurrently with lookups.
+ */
+template <typename Leaf>
+class SpatialTree {
+    struct Node {
+        /// @brief The two halves of the cell, or 0 for leaves (the root can never be a child).
+        std::array<uint32_t, 2> children {};
+        /// @brief The axis along which the cell is split (cycling through all axes with increasing depth).
+        int axis = 0;
+        Leaf leaf;
+    };
+
+    /// @brief A cube enclosing the scene, so that repeated splits produce cells of similar extent along all axes.
+    Bounds m_bounds;
+    std::vector<Node> m_nodes;
+
+public:
+    SpatialTree(const Bounds &bounds) : m_nodes(1) {
+        const Vector extent = bounds.diagonal();
+        const float size = std::max({ extent.x(), extent.y(), extent.z() }) * (1 + Epsilon) + Epsilon;
+        const Point center = bounds.center();
+        m_bounds = Bounds(center - Vector(size / 2), center + Vector(size / 2));
+    }
+
+    /// @brief Finds the leaf whose cell contains the given point.
+    Leaf &lookup(const Point &position) {
+        Vector point = (position - m_bounds.min()) / m_bounds.diagonal();
+        uint32_t index = 0;
+        while (m_nodes[index].children[0]) {
+            const Node &node = m_nodes[index];
+            const float coordinate = clamp(point[node.axis], 0.f, 1.f);
+            const int child = coordinate >= 0.5f;
+            point[node.axis] = 2 * coordinate - child;
+            index = node.children[child];
+        }
+        return m_nodes[index].leaf;
+    }
+
+    /// @brief The number of leaves of the tree.
+    int leafCount() const { return int(m_nodes.size() + 1) / 2; }
+
+    /**
+     * @brief Splits every leaf for which @c shouldSplit returns true, repeatedly, until no leaf needs splitting.
+     * Both halves of a split cell start out with the data of the cell after it has been passed to @c split (e.g.,
+     * to divide recorded statistics between them).
+     */
+    template <typename ShouldSplit, typename Split>
+    void subdivide(ShouldSplit &&shouldSplit, Split &&split) {
+        std::vector<uint32_t> stack { 0 };
+        while (!stack.empty()) {
+            const uint32_t index = stack.back();
+            stack.pop_back();
+            if (m_nodes[index].children[0]) {
+                stack.push_back(m_nodes[index].children[0]);
+                stack.push_back(m_nodes[index].children[1]);
+                continue;
+            }
+            if (!shouldSplit(std::as_const(m_nodes[index].leaf))) continue;
+
+            Leaf leaf = m_nodes[index].leaf;
+            split(leaf);
+            const uint32_t first = uint32_t(m_nodes.size());
+            for (int child = 0; child < 2; child++) {
+                Node node;
+                node.axis = (m_nodes[index].axis + 1) % 3;
+                node.leaf = leaf;
+                m_nodes.push_back(node);
+                m_nodes[index].children[child] = first + child;
+            }
+            m_nodes[index].leaf = Leaf();
+            stack.push_back(first);
+            stack.push_back(first + 1);
+        }
+    }
+
+    /// @brief Invokes @c function on the data of every leaf.
+    template <typename Function>
+    void forEachLeaf(Function &&function) {
+        for (Node &node : m_nodes) {
+            if (!node.children[0]) function(node.leaf);
+        }
+    }
+};
+
+}
@@ -0,0 +1,369 @@
+#include <lightwave.hpp>
+
+#include "emission.hpp"
+#include "mis.hpp"
+
+#include <atomic>
+#include <mutex>
+
+namespace lightwave {
+
+/// @brief A photon that has arrived at a diffuse surface after scattering at least once.
+struct Photon {
+    Point position;
+    /// @brief The direction the photon came from (pointing away from the surface).
+    Vector wi;
+    Color power;
+    /// @brief The number of times the photon was scattered before it arrived.
+    int bounces;
+};
+
+/**
+ * @brief A hash grid over photons, stored as flat arrays: photons are sorted by the hash of their cell, so that the
+ * photons of each cell lie next to each other in memory, and lookups only need to visit the cells near the query.
+ * Distinct cells that share a hash are simply searched together.
+ */
+class PhotonGrid {
+    float m_cellSize = 1;
+    /// @brief The index of the first photon of each hash bucket (with one extra entry marking the end of the last one).
+    std::vector<uint32_t> m_bucketStart;
+    std::vector<Photon> m_photons;
+
+    Vector3i cell(const Point &position) const {
+        return Vector3i(int(std::floor(position.x() / m_cellSize)), int(std::floor(position.y() / m_cellSize)),
+                        int(std::floor(position.z() / m_cellSize)));
+    }
+
+    uint32_t bucket(const Vector3i &cell) const {
+        // the spatial hash of "Optimized Spatial Hashing for Collision Detection of Deformable Objects" [Teschner et al. 2003]
+        const uint32_t hash = (uint32_t(cell.x()) * 73856093u) ^ (uint32_t(cell.y()) * 19349663u) ^
+                              (uint32_t(cell.z()) * 83492791u);
+        return hash % uint32_t(m_bucketStart.size() - 1);
+    }
+
+public:
+    /// @brief The number of photons in the grid.
+    size_t size() const { return m_photons.size(); }
+
+    /// @brief Replaces the contents of the grid by the given photons, using cells of the given size (the largest query radius).
+    void build(const std::vector<Photon> &photons, float cellSize) {
+        m_cellSize = std::max(cellSize, Epsilon);
+        m_bucketStart.assign(std::max<size_t>(photons.size(), 1) + 1, 0);
+
+        // counting sort by bucket
+        std::vector<uint32_t> buckets(photons.size());
+        for (size_t i = 0; i < photons.size(); i++) {
+            buckets[i] = bucket(cell(photons[i].position));
+            m_bucketStart[buckets[i] + 1]++;
+        }
+        for (size_t i = 1; i < m_bucketStart.size(); i++) m_bucketStart[i] += m_bucketStart[i - 1];
+        m_photons.resize(photons.size());
+        std::vector<uint32_t> next(m_bucketStart.begin(), m_bucketStart.end() - 1);
+        for (size_t i = 0; i < photons.size(); i++) m_photons[next[buckets[i]]++] = photons[i];
+    }
+
+    /// @brief Invokes @c f for every photon within @c radius of @c position .
+    template <typename F>
+    void forEachNear(const Point &position, float radius, F f) const {
+        const Vector3i lower = cell(position - Vector(radius));
+        const Vector3i upper = cell(position + Vector(radius));
+        const float radiusSquared = sqr(radius);
+        for (int z = lower.z(); z <= upper.z(); z++) {
+            for (int y = lower.y(); y <= upper.y(); y++) {
+                for (int x = lower.x(); x <= upper.x(); x++) {
+                    const uint32_t b = bucket(Vector3i(x, y, z));
+                    for (uint32_t i = m_bucketStart[b]; i < m_bucketStart[b + 1]; i++) {
+                        if ((m_photons[i].position - position).lengthSquared() <= radiusSquared) f(m_photons[i]);
+                    }
+                }
+            }
+        }
+    }
+};
+
+/**
+ * @brief Stochastic progressive photon mapping [Hachisuka and Jensen 2009], which finds light paths that path tracing
+ * cannot, e.g., caustics of point lights seen through or reflected by glass.
+ * Each iteration traces one camera path per pixel through non-diffuse surfaces up to its first diffuse vertex (the
+ * visible point), adding emission and next event estimation along the way. It then traces photons from the lights,
+ * stores those that arrive at diffuse surfaces after scattering at least once in a @ref PhotonGrid , and gathers
+ * them at the visible points. Each pixel shrinks its gather radius as it accumulates photons, so that the estimate
+ * converges to the correct result. Light that reaches the visible point directly is left to next event estimation.
+ * @note The number of iterations is given by the sample count of the sampler.
+ */
+class SppmIntegrator : public SamplingIntegrator {
+    int m_depth;
+    /// @brief The number of photons traced per iteration.
+    int m_photons;
+    /// @brief The gather radius of all pixels in the first iteration.
+    float m_initialRadius;
+    /// @brief The fraction of newly gathered photons that is kept when the radius shrinks.
+    float m_alpha;
+
+    /// @brief The progressive estimate of a pixel.
+    struct PixelState {
+        /// @brief The sum of the light the camera paths have found (emission and next event estimation).
+        Color direct;
+        /// @brief The accumulated (unnormalized) flux of the photons within the gather radius.
+        Color flux;
+        /// @brief The number of photons the flux accounts for.
+        float photons = 0;
+        float radius;
+    };
+
+    /// @brief The first diffuse vertex of the camera path of a pixel in the current iteration.
+    struct VisiblePoint {
+        Intersection its;
+        /// @brief The throughput of the camera path up to the visible point.
+        Color weight;
+        int depth = 0;
+        bool valid = false;
+    };
+
+    /// @brief The weight of having found the light @c light by bsdf sampling with density @c bsdfPdf (from @c origin ).
+    float bsdfMisWeight(float bsdfPdf, const Light *light, const Point &origin, const Intersection &its) const {
+        if (!light || !light->canBeIntersected()) return 1;
+        const float lightPdf = m_scene->lightSelectionProbability(light, origin) * light->pdfDirect(origin, its);
+        return powerHeuristic(bsdfPdf, lightPdf);
+    }
+
+    static bool isDiffuse(const Intersection &its) {
+        return its.instance->bsdf() && its.instance->bsdf()->isDiffuse();
+    }
+
+    /**
+     * @brief Traces a camera path up to its first diffuse vertex, returning the light it has found along the way.
+     * Next event estimation is weighted against bsdf sampling, except at the visible point, where paths end.
+     */
+    Color traceCameraPath(const Ray &cameraRay, Color weight, VisiblePoint &visiblePoint, Sampler &rng) const {
+        Color light;
+        Ray ray = cameraRay;
+        float bsdfPdf = Infinity;
+        while (ray.depth < m_depth) {
+            const Intersection its = m_scene->intersect(ray, rng);
+            if (!its) {
+                const Color background = m_scene->evaluateBackground(ray.direction).value;
+                if (background != Color(0)) light += weight * bsdfMisWeight(bsdfPdf, m_scene->background(), ray.origin, its) * background;
+                break;
+            }
+            if (its.instance->emission()) {
+                light += weight * bsdfMisWeight(bsdfPdf, its.instance->light(), ray.origin, its) * its.evaluateEmission();
+            }
+
+            const bool diffuse = isDiffuse(its);
+            if (m_scene->hasLights() && ray.depth < m_depth - 1) {
+                const LightSample lightSample = m_scene->sampleLight(its.position, rng);
+                const DirectLightSample direct = lightSample.light->sampleDirect(its.position, rng);
+                if (!direct.isInvalid() &&
+                    !m_scene->intersect(Ray(its.position, direct.wi).normalized(), direct.distance, rng)) {
+                    const float misWeight = !diffuse && lightSample.light->canBeIntersected() ?
+                        powerHeuristic(lightSample.probability * direct.pdf, its.pdfBsdf(direct.wi)) : 1.f;
+                    light += weight * misWeight * direct.weight * its.evaluateBsdf(direct.wi).value / lightSample.probability;
+                }
+            }
+
+            if (diffuse) {
+                visiblePoint = { its, weight, ray.depth, true };
+                break;
+            }
+            if (ray.depth >= m_depth - 1) break;
+
+            const BsdfSample sample = its.sampleBsdf(rng);
+            if (sample.isInvalid()) break;
+            bsdfPdf = its.pdfBsdf(sample.wi);
+            if (bsdfPdf == 0) bsdfPdf = Infinity;
+            weight *= sample.weight;
+            ray = Ray(its.position, sample.wi, ray.depth + 1).normalized();
+        }
+        return light;
+    }
+
+    /**
+     * @brief Traces a photon from the lights, appending it to @c photons at every diffuse surface it arrives at after
+     * scattering at least once (and few enough times that some camera path can still use it).
+     * @note Refraction scales radiance with the inverse square of the relative index of refraction, which photons
+     * (that carry power) should not be. The factors cancel for photons that leave the objects they enter.
+     */
+    void tracePhoton(const AliasTable &lightDistribution, const Bounds &sceneBounds, std::vector<Photon> &photons,
+                     Sampler &rng) const {
+        float remapped;
+        const int lightIndex = lightDistribution.sample(rng.next(), remapped);
+        const EmissionSample emission = m_scene->lights()[lightIndex]->sampleEmission(sceneBounds, rng);
+        if (emission.isInvalid()) return;
+
+        Color power = emission.weight / lightDistribution.pmf(lightIndex);
+        Ray ray = emission.ray;
+        for (int bounces = 0; bounces <= m_depth - 2; bounces++) {
+            const Intersection its = m_scene->intersect(ray, rng);
+            if (!its) return;
+            if (bounces > 0 && isDiffuse(its)) photons.push_back({ its.position, its.wo, power, bounces });
+
+            const BsdfSample sample = its.sampleBsdf(rng);
+            if (sample.isInvalid()) return;
+            power *= sample.weight;
+            ray = Ray(its.position, sample.wi).normalized();
+        }
+    }
+
+public:
+    SppmIntegrator(const Properties &properties)
+    : SamplingIntegrator(properties) {
+        m_depth = properties.get<int>("depth", 5);
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_photons = properties.get<int>("photons", resolution.product());
+        m_initialRadius = properties.get<float>("radius", 0.01f * m_scene->getBoundingBox().diagonal().length());
+        m_alpha = properties.get<float>("alpha", 2.f / 3);
+        if (m_depth < 2 || m_photons < 1 || !(m_initialRadius > 0) || !(m_alpha > 0 && m_alpha <= 1)) {
+            lightwave_throw("sppm needs depth >= 2, photons >= 1, radius > 0 and 0 < alpha <= 1");
+        }
+    }
+
+    Color Li(const Ray &ray, Sampler &rng) override {
+        // without photons, only the light found by camera paths remains
+        VisiblePoint visiblePoint;
+        return traceCameraPath(ray, Color(1), visiblePoint, rng);
+    }
+
+    void execute() override {
+        if (!m_image) {
+            lightwave_throw("<integrator /> needs an <image /> child to render into!");
+        }
+        if (m_adaptive || m_progressive || options.isPartialRender()) {
+            logger(EWarn, "sppm renders in iterations that refine all pixels, ignoring progressive, adaptive and "
+                          "partial rendering");
+        }
+
+        const Vector2i resolution = m_scene->camera()->resolution();
+        m_image->initialize(resolution);
+        Streaming stream { *m_image };
+
+        const Bounds sceneBounds = m_scene->getBoundingBox();
+        std::vector<const Light *> lights;
+        for (const auto &light : m_scene->lights()) lights.push_back(light.get());
+        auto sampler = m_sampler->clone();
+        const AliasTable lightDistribution = emittedPowerDistribution(lights, sceneBounds, *sampler);
+        if (!(lightDistribution.total() > 0)) {
+            logger(EWarn, "none of the lights can emit photons, only the light found by camera paths is rendered");
+        }
+
+        std::vector<PixelState> pixels(resolution.product());
+        for (PixelState &pixel : pixels) pixel.radius = m_initialRadius;
+        std::vector<VisiblePoint> visiblePoints(resolution.product());
+
+        const int iterations = m_sampler->samplesPerPixel();
+        ProgressReporter progress { iterations };
+        double photonTime = 0, gatherTime = 0;
+        int64_t storedPhotons = 0, lookups = 0;
+        std::atomic<int64_t> gatheredPhotons = 0;
+        PhotonGrid grid;
+        for (int iteration = 0; iteration < iterations; iteration++) {
+            for_each_parallel(BlockSpiral(resolution, Vector2i(64)), [&](auto block) {
+                auto sampler = m_sampler->clone();
+                for (auto pixel : block) {
+                    const int index = pixel.y() * resolution.x() + pixel.x();
+                    sampler->seed(pixel, iteration);
+                    const auto cameraSample = m_scene->camera()->sample(pixel, *sampler);
+                    visiblePoints[index] = VisiblePoint();
+                    pixels[index].direct +=
+                        traceCameraPath(cameraSample.ray, cameraSample.weight, visiblePoints[index], *sampler);
+                }
+            });
+
+            Timer photonTimer;
+            std::vector<Photon> photons;
+            std::mutex mutex;
+            if (lightDistribution.total() > 0) {
+                for_each_parallel(ChunkedRange(m_photons, 4096), [&](Range range) {
+                    auto sampler = m_sampler->clone();
+                    std::vector<Photon> local;
+                    for (int i : range) {
+                        sampler->seed(iteration * m_photons + i);
+                        tracePhoton(lightDistribution, sceneBounds, local, *sampler);
+                    }
+                    std::lock_guard lock { mutex };
+                    photons.insert(photons.end(), local.begin(), local.end());
+                });
+            }
+            float maxRadius = 0;
+            for (const PixelState &pixel : pixels) maxRadius = std::max(maxRadius, pixel.radius);
+            grid.build(photons, maxRadius);
+            photonTime += photonTimer.getElapsedTime();
+            storedPhotons += int64_t(grid.size());
+
+            Timer gatherTimer;
+            for_each_parallel(ChunkedRange(resolution.product(), 1024), [&](Range range) {
+                int64_t found = 0;
+                for (int index : range) {
+                    const VisiblePoint &visiblePoint = visiblePoints[index];
+                    if (!visiblePoint.valid) continue;
+                    PixelState &pixel = pixels[index];
+                    const Intersection &its = visiblePoint.its;
+
+                    Color flux;
+                    int count = 0;
+                    grid.forEachNear(its.position, pixel.radius, [&](const Photon &photon) {
+                        if (visiblePoint.depth + photon.bounces > m_depth - 2) return;
+                        // photon densities are per area, so the cosine included in the bsdf is divided out again
+                        const float cosTheta = its.frame.normal.dot(photon.wi);
+                        if (cosTheta <= 0) return;
+                        flux += its.evaluateBsdf(photon.wi).value / cosTheta * photon.power;
+                        count++;
+                    });
+                    found += count;
+                    if (count == 0) continue;
+
+                    const float photonCount = pixel.photons + m_alpha * count;
+                    const float radius = pixel.radius * std::sqrt(photonCount / (pixel.photons + count));
+                    pixel.flux = (pixel.flux + visiblePoint.weight * flux) * sqr(radius / pixel.radius);
+                    pixel.photons = photonCount;
+                    pixel.radius = radius;
+                }
+                gatheredPhotons += found;
+            });
+            gatherTime += gatherTimer.getElapsedTime();
+            for (const VisiblePoint &visiblePoint : visiblePoints) lookups += visiblePoint.valid;
+
+            const float emitted = float(iteration + 1) * m_photons;
+            for (auto pixel : m_image->bounds()) {
+                const PixelState &state = pixels[pixel.y() * resolution.x() + pixel.x()];
+                m_image->get(pixel) =
+                    state.direct / float(iteration + 1) + state.flux / (emitted * Pi * sqr(state.radius));
+            }
+            stream.update();
+            progress += 1;
+        }
+        progress.finish();
+
+        const double tracedPhotons = double(iterations) * m_photons;
+        logger(EInfo,
+               "traced %.3g photons at %.3g per second (%.1f%% stored), gathered at %lld visible points at %.3g "
+               "lookups per second (%.1f photons each)",
+               tracedPhotons, tracedPhotons / std::max(photonTime, 1e-3), 100 * storedPhotons / tracedPhotons,
+               (long long) lookups, lookups / std::max(gatherTime, 1e-3),
+               lookups ? double(gatheredPhotons.load()) / lookups : 0.);
+        m_image->save();
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "SppmIntegrator[\n"
+            "  sampler = %s,\n"
+            "  image = %s,\n"
+            "  depth = %d,\n"
+            "  photons = %d,\n"
+            "  radius = %f,\n"
+            "  alpha = %f,\n"
+            "]",
+            indent(m_sampler),
+            indent(m_image),
+            m_depth,
+            m_photons,
+            m_initialRadius,
+            m_alpha
+        );
+    }
+};
+
+}
+
+REGISTER_INTEGRATOR(SppmIntegrator, "sppm")
@@ -1,41 +1,151 @@
 #include <lightwave.hpp>
 
+#include <random>
+
 namespace lightwave {
 
+namespace {
+
+/// @brief A fixed sequence of random numbers, used to estimate properties of lights once while loading the scene.
+class EstimationSampler final : public Sampler {
+    std::minstd_rand m_engine;
+    std::uniform_real_distribution<float> m_distribution { 0, 1 };
+
+public:
+    float next() override { return m_distribution(m_engine); }
+    void seed(int index) override { m_engine.seed(index + 1); }
+    void seed(const Point2i &pixel, int sampleIndex) override { seed(sampleIndex); }
+    ref<Sampler> clone() const override { return std::make_shared<EstimationSampler>(*this); }
+    std::string toString() const override { return "EstimationSampler[]"; }
+};
+
+}
+
 class AreaLight final : public Light {
 
 
 public:
     AreaLight(const Properties &properties) {
         m_instance = properties.getChild<Instance>();
+        if (!m_instance->emission()) {
+            lightwave_throw("area lights require an emissive instance, %s has no emission", indent(m_instance));
+        }
+        // lets the integrators find the light (and its sampling density) when a ray hits the instance
+        m_instance->setLight(this);
+
+        // the surface area, which is the inverse of the density of the (uniform) points sampled by sampleEmission
+        static constexpr int SampleCount = 64;
+        EstimationSampler rng;
+        rng.seed(0);
+        double area = 0;
+        for (int i = 0; i < SampleCount; i++) {
+            const AreaSample sample = m_instance->sampleArea(rng);
+            if (sample.pdf > 0) area += 1. / sample.pdf / SampleCount;
+        }
+        m_area = float(area);
     }
 
     DirectLightSample sampleDirect(const Point &origin,
                                    Sampler &rng) const override {
-        AreaSample sampleArea = m_instance->sampleArea(rng);
-        Point lightPosition = sampleArea.position;
-        Vector wi = lightPosition - origin;   //direction
-        // Bounds box = m_instance->getBoundingBox();
-        // Point boxLength = box.max() - box.min();
-        // float area = abs(boxLength.x() * boxLength.y() * boxLength.z());
-
-        Color intensity = m_instance->emission()->evaluate(sampleArea.uv, wi.normalized()).value;
+        AreaSample sampleArea = m_instance->sampleArea(origin, rng);
+        if (!(sampleArea.pdf > 0)) return DirectLightSample::invalid();
+
+        Vector wi = sampleArea.position - origin;   //direction
+        const float distance = wi.length();
+        wi /= distance;
+
+        // convert the area density of the sampled point into a solid angle density as seen from the origin
+        const float cosLight = abs(sampleArea.frame.normal.dot(wi));
+        if (cosLight == 0) return DirectLightSample::invalid();
+        const float pdf = sampleArea.pdf * sqr(distance) / cosLight;
+
+        Color intensity = m_instance->emission()->evaluate(sampleArea.uv, sampleArea.frame.toLocal(-wi)).value;
         return DirectLightSample{
-            .wi = wi.normalized(), //y
-            .weight = intensity * Inv4Pi / wi.lengthSquared(),
-            .distance = wi.length(), //y
+            .wi = wi,
+            .weight = intensity / pdf,
+            .distance = distance,
+            .pdf = pdf,
+            .normal = sampleArea.frame.normal,
+        };
+    }
+
+    float pdfDirect(const Point &origin, const Intersection &its) const override {
+        const float cosLight = abs(its.frame.normal.dot(its.wo));
+        if (cosLight == 0) return 0;
+        return its.pdf * (its.position - origin).lengthSquared() / cosLight;
+    }
+
+    EmissionSample sampleEmission(const Bounds &sceneBounds, Sampler &rng) const override {
+        const AreaSample sampleArea = m_instance->sampleArea(rng);
+        if (!(sampleArea.pdf > 0)) return EmissionSample::invalid();
+
+        // cosine weighted directions cancel the cosine of the emitted power, leaving pi over the density of the point
+        const Vector local = squareToCosineHemisphere(rng.next2D());
+        const Color emission = m_instance->emission()->evaluate(sampleArea.uv, local).value;
+        return EmissionSample{
+            .ray = Ray(sampleArea.position, sampleArea.frame.toWorld(local)).normalized(),
+            .weight = emission * Pi / sampleArea.pdf,
+            .normal = sampleArea.frame.normal,
         };
     }
 
-    bool canBeIntersected() const override { return false; }
+    EmissionPdf pdfEmission(const Point &position, const Vector &normal, const Vector &direction) const override {
+        if (!(m_area > 0)) return { 0, 0 };
+        return { 1 / m_area, std::max(normal.dot(direction), 0.f) * InvPi };
+    }
+
+    bool canBeIntersected() const override { return m_instance->isVisible(); }
+
+    std::optional<LightBounds> lightBounds() const override {
+        // estimate the emitted power and the spread of surface normals from a fixed set of area samples
+        static constexpr int SampleCount = 64;
+        EstimationSampler rng;
+        rng.seed(0);
+
+        double power = 0;
+        Vector normalSum(0);
+        std::vector<Vector> normals;
+        for (int i = 0; i < SampleCount; i++) {
+            const AreaSample sample = m_instance->sampleArea(rng);
+            if (!(sample.pdf > 0)) continue;
+            // the radiant exitance of a lambertian emitter is pi times its radiance
+            const Color emission = m_instance->emission()->evaluate(sample.uv, Vector(0, 0, 1)).value;
+            power += Pi * emission.luminance() / sample.pdf / SampleCount;
+            normalSum += sample.frame.normal;
+            normals.push_back(sample.frame.normal);
+        }
+
+        // planar emitters get a tight cone of normals, all others are assumed to face all directions (sampled normals
+        // cannot conservatively bound curved surfaces)
+        LightBounds bounds {
+            .bounds = m_instance->getBoundingBox(),
+            .power = float(power),
+            .axis = Vector(0, 0, 1),
+            .cosThetaO = -1,
+            .cosThetaE = 0,
+        };
+        if (normalSum.lengthSquared() > 0) {
+            const Vector axis = normalSum.normalized();
+            float cosThetaO = 1;
+            for (const Vector &normal : normals) cosThetaO = std::min(cosThetaO, axis.dot(normal));
+            if (cosThetaO > 0.9999f) {
+                bounds.axis = axis;
+                bounds.cosThetaO = cosThetaO;
+            }
+        }
+        return bounds;
+    }
 
     std::string toString() const override {
         return tfm::format("AreaLight[\n"
-                           "]");
+                           "  instance = %s\n"
+                           "]",
+                           indent(m_instance));
     }
 
 private:
     ref<Instance> m_instance;
+    float m_area;
 };
 
 } // namespace lightwave
@@ -18,7 +18,17 @@ public:
         return DirectLightSample{
             .wi = m_direction.normalized(),
             .weight = m_intensity,
-            .distance = INFINITY
+            .distance = INFINITY,
+            .pdf = Infinity,
+        };
+    }
+
+    EmissionSample sampleEmission(const Bounds &sceneBounds, Sampler &rng) const override {
+        float area;
+        const Ray ray = sampleSceneDisk(sceneBounds, -m_direction.normalized(), rng.next2D(), area);
+        return EmissionSample{
+            .ray = ray,
+            .weight = m_intensity * area,
         };
     }
 
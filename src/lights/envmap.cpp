@@ -9,10 +9,71 @@ class EnvironmentMap final : public BackgroundLight {
     /// @brief An optional transform from local-to-world space
     ref<Transform> m_transform;
 
+    /// @brief Whether to sample directions proportional to the luminance of the map (instead of uniformly).
+    bool m_importanceSampling;
+    /// @brief The luminance of the map over its lat-long parametrization, weighted by the size of the pixels on the sphere.
+    Distribution2D m_distribution;
+
+    /// @brief Maps a direction in local coordinates to its lat-long texture coordinates (the inverse of @ref uvToDirection ).
+    static Point2 directionToUv(const Vector &localDir) {
+        float phi = atan2(localDir.z(), localDir.x()); //already take care of x=0, returns the arccosine of z/x in the range -pi to pi radians
+        float theta = acos(clamp(localDir.y(), -1.f, 1.f)); //returns the arccosine of x in the range 0 to pi radians
+        return { 0.5f - Inv2Pi * phi, InvPi * theta };
+    }
+
+    /// @brief Maps lat-long texture coordinates to a direction in local coordinates.
+    static Vector uvToDirection(const Point2 &uv) {
+        const float phi = 2 * Pi * (0.5f - uv.x());
+        const float theta = Pi * uv.y();
+        return { std::sin(theta) * std::cos(phi), std::cos(theta), std::sin(theta) * std::sin(phi) };
+    }
+
+    /**
+     * @brief Converts a density over texture coordinates into a solid angle density.
+     * @note The lat-long parametrization stretches rows near the poles, where pixels cover less solid angle (the
+     * Jacobian is 2 pi^2 sin(theta)).
+     */
+    static float uvToSolidAnglePdf(float pdf, const Point2 &uv) {
+        const float sinTheta = sin(Pi * uv.y());
+        if (sinTheta <= 0) return 0;
+        return pdf / (2 * Pi * Pi * sinTheta);
+    }
+
+    /// @brief Tabulates the luminance of the map, at the resolution of its texture (or a default one for procedural textures).
+    void buildDistribution() {
+        Point2i resolution = m_texture->resolution();
+        if (resolution.x() <= 0 || resolution.y() <= 0) resolution = { 512, 256 };
+
+        std::vector<float> weights(std::size_t(resolution.x()) * resolution.y());
+        for (int y = 0; y < resolution.y(); y++) {
+            for (int x = 0; x < resolution.x(); x++) {
+                const Point2 uv { (x + 0.5f) / resolution.x(), (y + 0.5f) / resolution.y() };
+                const Vector direction = localToWorld(uvToDirection(uv));
+                weights[std::size_t(y) * resolution.x() + x] =
+                    std::max(evaluate(direction).value.luminance(), 0.f) * sin(Pi * uv.y());
+            }
+        }
+        m_distribution = Distribution2D(weights, resolution);
+    }
+
+    /// @brief Transforms a direction from local to world coordinates.
+    Vector localToWorld(const Vector &localDir) const {
+        if (!m_transform) return localDir;
+        return m_transform->apply(localDir).normalized();
+    }
+
+    /// @brief Transforms a direction from world to local coordinates.
+    Vector worldToLocal(const Vector &direction) const {
+        if (!m_transform) return direction;
+        return m_transform->inverse(direction).normalized();
+    }
+
 public:
     EnvironmentMap(const Properties &properties) {
         m_texture   = properties.getChild<Texture>();
         m_transform = properties.getOptionalChild<Transform>();
+        m_importanceSampling = properties.get<bool>("importanceSampling", true);
+        if (m_importanceSampling) buildDistribution();
     }
 
     BackgroundLightEval evaluate(const Vector &direction) const override {
@@ -27,18 +88,9 @@ public:
             };
         }
         else {
-            // world to local
-            Vector localDir = m_transform->inverse(direction).normalized();
-
-            // 3D dir to spherical coord(theta, phi)
-            float phi = atan2(localDir.z(), localDir.x()); //already take care of x=0, returns the arccosine of z/x in the range -pi to pi radians
-            // assert(localDir.y() >= -1.f); //acos will be indefite, for debug
-            // assert(localDir.y() <= 1.f);   //acos will be indefite, for debug
-            float theta = acos(localDir.y()); //returns the arccosine of x in the range 0 to pi radians
-            
-            // spherical coord (theta, phi) to 2D coord
+            // world to local, then 3D dir to spherical coord(theta, phi) to 2D coord
             return {
-            .value = m_texture->evaluate(Vector2(0.5f-Inv2Pi * phi,  InvPi * theta))
+            .value = m_texture->evaluate(directionToUv(worldToLocal(direction)))
             };
         }
 
@@ -46,26 +98,61 @@ public:
 
     DirectLightSample sampleDirect(const Point &origin,
                                    Sampler &rng) const override {
-        Vector direction = squareToUniformSphere(rng.next2D());
-        auto E           = evaluate(direction);
+        if (!m_importanceSampling) {
+            Vector direction = squareToUniformSphere(rng.next2D());
+            auto E           = evaluate(direction);
+
+            return {
+                .wi     = direction,
+                .weight = E.value / Inv4Pi,
+                .distance = Infinity,
+                .pdf = Inv4Pi,
+            };
+        }
+
+        // pick a texel proportional to its luminance (useful for environment maps with bright tiny light sources,
+        // like the sun for example)
+        const Point2 uv  = m_distribution.sample(rng.next2D());
+        const float pdf  = uvToSolidAnglePdf(m_distribution.pdf(uv), uv);
+        if (pdf == 0) return DirectLightSample::invalid();
 
-        // implement better importance sampling here, if you ever need it
-        // (useful for environment maps with bright tiny light sources, like the
-        // sun for example)
+        const Vector direction = localToWorld(uvToDirection(uv));
+        auto E                 = evaluate(direction);
 
         return {
             .wi     = direction,
-            .weight = E.value / Inv4Pi,
+            .weight = E.value / pdf,
             .distance = Infinity,
+            .pdf = pdf,
         };
     }
 
+    EmissionSample sampleEmission(const Bounds &sceneBounds, Sampler &rng) const override {
+        // the direction is picked as for a shading point, as directions do not depend on it for infinitely far lights
+        const DirectLightSample direct = sampleDirect(sceneBounds.center(), rng);
+        if (direct.isInvalid()) return EmissionSample::invalid();
+
+        float area;
+        const Ray ray = sampleSceneDisk(sceneBounds, -direct.wi, rng.next2D(), area);
+        return EmissionSample{
+            .ray = ray,
+            .weight = direct.weight * area,
+        };
+    }
+
+    float pdfDirect(const Point &origin, const Intersection &its) const override {
+        if (!m_importanceSampling) return Inv4Pi;
+        const Point2 uv = directionToUv(worldToLocal(-its.wo));
+        return uvToSolidAnglePdf(m_distribution.pdf(uv), uv);
+    }
+
     std::string toString() const override {
         return tfm::format("EnvironmentMap[\n"
                            "  texture = %s,\n"
-                           "  transform = %s\n"
+                           "  transform = %s,\n"
+                           "  importanceSampling = %s\n"
                            "]",
-                           indent(m_texture), indent(m_transform));
+                           indent(m_texture), indent(m_transform), m_importanceSampling);
     }
 };
 
@@ -21,11 +21,35 @@ public:
             .wi = wi.normalized(),
             .weight = m_power * Inv4Pi / wi.lengthSquared(),
             .distance = wi.length(),
+            .pdf = Infinity,
         };
     }
 
+    EmissionSample sampleEmission(const Bounds &sceneBounds, Sampler &rng) const override {
+        // the intensity of power / 4pi divided by the uniform density of 1 / 4pi
+        return EmissionSample{
+            .ray = Ray(m_position, squareToUniformSphere(rng.next2D())),
+            .weight = m_power,
+        };
+    }
+
+    EmissionPdf pdfEmission(const Point &position, const Vector &normal, const Vector &direction) const override {
+        return { 1, Inv4Pi };
+    }
+
     bool canBeIntersected() const override { return false; }
 
+    std::optional<LightBounds> lightBounds() const override {
+        // emits the same intensity into all directions
+        return LightBounds{
+            .bounds = Bounds(m_position, m_position),
+            .power = m_power.luminance(),
+            .axis = Vector(0, 0, 1),
+            .cosThetaO = -1,
+            .cosThetaE = 0,
+        };
+    }
+
     std::string toString() const override {
         return tfm::format("PointLight[\n"
                            "]");
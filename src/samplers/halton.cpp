@@ -1,49 +1,176 @@
 #include <lightwave.hpp>
 #include "pcg32.h"
 
+#include <array>
+#include <numeric>
+#include <utility>
+
 namespace lightwave {
 
-class Halton : public Sampler {
-    int m_primeSeed;
-    bool useScreenOffset = true;
-    Point2 m_offsetPixel;
-    pcg32 m_pcg;
-    int m_pcgSeed = 1337;
+namespace {
+
+/// @brief The number of dimensions (each with its own prime base) before the sequence wraps around to the first one.
+constexpr int DimensionCount = 1000;
+
+constexpr std::array<uint16_t, DimensionCount> computePrimes() {
+    std::array<uint16_t, DimensionCount> primes {};
+    int count = 0;
+    for (int candidate = 2; count < DimensionCount; candidate++) {
+        bool isPrime = true;
+        for (int i = 0; i < count && primes[i] * primes[i] <= candidate; i++) {
+            if (candidate % primes[i] == 0) {
+                isPrime = false;
+                break;
+            }
+        }
+        if (isPrime) primes[count++] = uint16_t(candidate);
+    }
+    return primes;
+}
+
+/// @brief The base of each dimension.
+constexpr std::array<uint16_t, DimensionCount> Primes = computePrimes();
+
+constexpr std::array<uint32_t, DimensionCount + 1> computePermutationOffsets() {
+    std::array<uint32_t, DimensionCount + 1> offsets {};
+    for (int i = 0; i < DimensionCount; i++) offsets[i + 1] = offsets[i] + Primes[i];
+    return offsets;
+}
+
+/// @brief Where the digit permutation of each dimension starts (all permutations are stored back to back).
+constexpr std::array<uint32_t, DimensionCount + 1> PermutationOffsets = computePermutationOffsets();
+
+constexpr float OneMinusEpsilon = 0x1.fffffep-1;
+
+/// @brief An integer hash with good avalanche behavior ("lowbias32" by Chris Wellons).
+constexpr uint32_t hash(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+}
+
+constexpr uint32_t reverseBits(uint32_t v) {
+    v = (v >> 16) | (v << 16);
+    v = ((v & 0xff00ff00u) >> 8) | ((v & 0x00ff00ffu) << 8);
+    v = ((v & 0xf0f0f0f0u) >> 4) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v & 0xccccccccu) >> 2) | ((v & 0x33333333u) << 2);
+    v = ((v & 0xaaaaaaaau) >> 1) | ((v & 0x55555555u) << 1);
+    return v;
+}
+
+/**
+ * @brief Mirrors the digits of @c index (in the base of the given dimension) at the decimal point, after replacing
+ * every digit through @c permutation . The base is a compile time constant, so that the divisions become
+ * multiplications.
+ */
+template <size_t Dimension>
+float scrambledRadicalInverse(const uint16_t *permutation, uint32_t index) {
+    constexpr uint32_t base = Primes[Dimension];
+    constexpr float invBase = 1.f / base;
+    uint64_t reversedDigits = 0;
+    float invBaseN = 1;
+    while (index) {
+        const uint32_t next = index / base;
+        const uint32_t digit = index - next * base;
+        reversedDigits = reversedDigits * base + permutation[digit];
+        invBaseN *= invBase;
+        index = next;
+    }
+    // the infinitely many leading zeros of the index all turn into the same digit (which sums to a geometric series)
+    return std::min(invBaseN * (reversedDigits + invBase * permutation[0] / (1 - invBase)), OneMinusEpsilon);
+}
+
+/// @brief In base two, the digits can be mirrored all at once, and the only scrambling is to flip all of them.
+template <>
+float scrambledRadicalInverse<0>(const uint16_t *permutation, uint32_t index) {
+    uint32_t bits = reverseBits(index);
+    if (permutation[0]) bits = ~bits;
+    return std::min(float(bits) * 0x1p-32f, OneMinusEpsilon);
+}
+
+using RadicalInverseFunction = float (*)(const uint16_t *, uint32_t);
+
+template <size_t... Dimensions>
+constexpr std::array<RadicalInverseFunction, sizeof...(Dimensions)> makeRadicalInverses(std::index_sequence<Dimensions...>) {
+    return { &scrambledRadicalInverse<Dimensions>... };
+}
+
+/// @brief The radical inverse of each dimension, specialized for its base.
+constexpr std::array<RadicalInverseFunction, DimensionCount> RadicalInverses =
+    makeRadicalInverses(std::make_index_sequence<DimensionCount>());
+
+}
+
+/**
+ * @brief Generates the Halton sequence, whose dimensions are radical inverses in the prime bases 2, 3, 5, ... and
+ * which covers the unit hypercube more evenly than independent random numbers.
+ * All pixels share the same sequence (indexed by the sample index), and are decorrelated by shifting every dimension
+ * by a random offset per pixel (Cranley-Patterson rotation). Sequences seeded without a pixel are not shifted.
+ * The digits of each base are scrambled by a random permutation [Faure 1992], which breaks up the correlation between
+ * dimensions with large bases.
+ * @note The permutations are generated once and shared by all clones of the sampler.
+ */
+class Halton final : public Sampler {
+    int m_seed;
+    bool m_scramble;
+    /// @brief The digit permutation of every dimension, stored back to back (see @ref PermutationOffsets ).
+    std::shared_ptr<const std::vector<uint16_t>> m_permutations;
+
+    uint32_t m_sampleIndex = 0;
+    int m_dimension = 0;
+    /// @brief Determines the random offset of every dimension for the current pixel (zero disables the offsets).
+    uint32_t m_pixelHash = 0;
+
+    static std::shared_ptr<const std::vector<uint16_t>> computePermutations(int seed, bool scramble) {
+        auto permutations = std::make_shared<std::vector<uint16_t>>(PermutationOffsets.back());
+        pcg32 rng;
+        rng.seed(seed);
+        for (int dimension = 0; dimension < DimensionCount; dimension++) {
+            const auto begin = permutations->begin() + PermutationOffsets[dimension];
+            const auto end = permutations->begin() + PermutationOffsets[dimension + 1];
+            std::iota(begin, end, uint16_t(0));
+            if (scramble) rng.shuffle(begin, end);
+        }
+        return permutations;
+    }
 
 public:
     Halton(const Properties &properties) : Sampler(properties) {
-        m_pcgSeed = properties.get<int>("seed", 1337);
+        m_seed = properties.get<int>("seed", 1337);
+        m_scramble = properties.get<bool>("scramble", true);
+        m_permutations = computePermutations(m_seed, m_scramble);
     }
 
     void seed(int sampleIndex) override {
-        m_primeSeed = sampleIndex;
-        m_pcg.seed(m_pcgSeed, sampleIndex);
-        resetPrime();
+        m_sampleIndex = uint32_t(sampleIndex);
+        m_dimension = 0;
+        m_pixelHash = 0;
     }
 
     void seed(const Point2i &pixel, int sampleIndex) override {
-        m_primeSeed = sampleIndex;
-        resetPrime();
-
-        // seed it, seed it. i said SEED IT!!!
-        uint64_t hash = (uint64_t(pixel.x()) << 32) ^ pixel.y();
-        m_pcg.seed(m_pcgSeed, hash);
-        m_offsetPixel = {m_pcg.nextFloat(), m_pcg.nextFloat()};        
+        m_sampleIndex = uint32_t(sampleIndex);
+        m_dimension = 0;
+        m_pixelHash = hash(hash(uint32_t(pixel.x()) ^ uint32_t(m_seed)) + uint32_t(pixel.y())) | 1;
     }
 
     float next() override {
-        return RadicalInverse(nextPrime(), m_primeSeed);
+        const int dimension = m_dimension;
+        if (++m_dimension == DimensionCount) m_dimension = 0;
+        float value = RadicalInverses[dimension](m_permutations->data() + PermutationOffsets[dimension], m_sampleIndex);
+        if (m_pixelHash) {
+            value += float(hash(m_pixelHash + uint32_t(dimension) * 0x9e3779b9u) >> 8) * 0x1p-24f;
+            // wraps around without a branch, which would be mispredicted half of the time
+            value -= float(value >= 1);
+        }
+        return std::max(value, 0.000001f);
     }
 
     Point2 next2D() override {
-        if(useScreenOffset){
-            float posX = next() + m_offsetPixel.x();
-            float posY = next() + m_offsetPixel.y();            
-            return {std::fmod(posX, 1.0f), std::fmod(posY, 1.0f)};
-        }
-        else {
-            return {next(), next()};
-        }
+        const float x = next();
+        return { x, next() };
     }
 
     ref<Sampler> clone() const override {
@@ -53,66 +180,15 @@ public:
     std::string toString() const override {
         return tfm::format(
             "Halton[\n"
-            "  count = %d\n"
+            "  count = %d,\n"
+            "  seed = %d,\n"
+            "  scramble = %s\n"
             "]",
-            m_samplesPerPixel
+            m_samplesPerPixel,
+            m_seed,
+            m_scramble
         );
     }
-
-private:
-    float nextPrime() {
-        // if exceed the counts
-        if (m_primeCount + 1 > m_maxPrimeCount) {
-            resetPrime();
-        }
-        return nextPrimeValue(m_lastPrimeNum);
-    }
-
-    void resetPrime(){
-        m_lastPrimeNum = 1;
-        m_primeCount = 0;
-    }
-
-    inline float RadicalInverse(int base, uint64_t a) const {
-        float invBase = (float)1 / (float)base, invBaseM = 1;
-        uint64_t reversedDigits = 0;
-        while (a) {
-            // Extract least significant digit from _a_ and update _reversedDigits_
-            uint64_t next = int(a / base);
-            uint64_t digit = int(a - (next * base));
-            reversedDigits = reversedDigits * base + digit;
-            invBaseM *= invBase;
-            a = next;
-        }
-        return std::max(std::min(reversedDigits * invBaseM, OneMinusEpsilon), 0.000001f);
-    }
-
-    int nextPrimeValue(int lastPrime){
-        int newPrime = lastPrime;
-        bool isPrime = true;
-        while(true){
-            newPrime += 1;
-            isPrime = true;
-            for(int i=2; i<newPrime; i++){
-                if ((newPrime % i) == 0){
-                    isPrime = false;
-                    break;
-                }
-            }
-            if (isPrime) {
-                break;
-            }
-        }
-        m_primeCount += 1;
-        m_lastPrimeNum = newPrime;
-        return newPrime;
-    }
-
-    int m_primeCount = 0;
-    int m_maxPrimeCount = 1000;
-    int m_lastPrimeNum = 2;
-    static constexpr float OneMinusEpsilon = 0x1.fffffep-1;
-
 };
 
 }
@@ -12,7 +12,7 @@ namespace lightwave {
  * jittered sampling or blue noise sampling).
  * @see Internally, this sampler uses the PCG32 library to generate random numbers.
  */
-class Independent : public Sampler {
+class Independent final : public Sampler {
     uint64_t m_seed;
     pcg32 m_pcg;
 
@@ -36,6 +36,12 @@ public:
         return m_pcg.nextFloat();
     }
 
+    Point2 next2D() override {
+        // draws both coordinates with a single virtual call
+        const float x = m_pcg.nextFloat();
+        return { x, m_pcg.nextFloat() };
+    }
+
     ref<Sampler> clone() const override {
         return std::make_shared<Independent>(*this);
     }
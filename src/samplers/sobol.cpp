@@ -0,0 +1,71 @@
+#include <lightwave.hpp>
+#include "sobol.hpp"
+
+namespace lightwave {
+
+/**
+ * @brief Generates the Sobol sequence, whose samples are stratified in every power of two sized box of the unit
+ * hypercube that their count allows for, which gives much faster convergence than independent random numbers.
+ * Every pixel uses its own Owen scrambling of the sequence [Owen 1995], which randomizes the samples while preserving
+ * their stratification. Dimensions beyond the first 1024 reuse the generator matrices with a different scrambling,
+ * and hence are only stratified on their own.
+ */
+class Sobol final : public Sampler {
+    int m_seed;
+    const uint32_t *m_matrices;
+
+    uint32_t m_sampleIndex = 0;
+    uint32_t m_dimension = 0;
+    /// @brief Determines the scrambling of every dimension for the current pixel.
+    uint32_t m_pixelHash = 0;
+
+public:
+    Sobol(const Properties &properties) : Sampler(properties) {
+        m_seed = properties.get<int>("seed", 1337);
+        m_matrices = sobol::matrices();
+    }
+
+    void seed(int sampleIndex) override {
+        m_sampleIndex = uint32_t(sampleIndex);
+        m_dimension = 0;
+        m_pixelHash = sobol::mixBits32(uint32_t(m_seed));
+    }
+
+    void seed(const Point2i &pixel, int sampleIndex) override {
+        m_sampleIndex = uint32_t(sampleIndex);
+        m_dimension = 0;
+        m_pixelHash = uint32_t(sobol::mixBits(
+            (uint64_t(uint32_t(pixel.x())) << 32 | uint32_t(pixel.y())) ^ sobol::mixBits(uint64_t(uint32_t(m_seed)))));
+    }
+
+    float next() override {
+        const uint32_t dimension = m_dimension++;
+        const uint32_t *matrix = m_matrices + (dimension % sobol::DimensionCount) * sobol::MatrixSize;
+        return sobol::owenScrambled(
+            sobol::sample(matrix, m_sampleIndex), sobol::mixBits32(m_pixelHash + dimension * 0x9e3779b9u));
+    }
+
+    Point2 next2D() override {
+        const float x = next();
+        return { x, next() };
+    }
+
+    ref<Sampler> clone() const override {
+        return std::make_shared<Sobol>(*this);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "Sobol[\n"
+            "  count = %d,\n"
+            "  seed = %d\n"
+            "]",
+            m_samplesPerPixel,
+            m_seed
+        );
+    }
+};
+
+}
+
+REGISTER_SAMPLER(Sobol, "sobol")
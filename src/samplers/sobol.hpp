@@ -0,0 +1,158 @@
+/**
+ * @brief The Sobol sequence and its randomization by Owen scrambling, shared by the Sobol samplers.
+ * @file sobol.hpp
+ */
+
+#pragma once
+
+#include <lightwave/core.hpp>
+#include "pcg32.h"
+
+#include <algorithm>
+#include <vector>
+
+namespace lightwave::sobol {
+
+/// @brief The number of dimensions with their own generator matrix.
+static constexpr int DimensionCount = 1024;
+/// @brief The number of columns of each generator matrix, i.e., the number of bits of the sample index that are used.
+static constexpr int MatrixSize = 64;
+
+static constexpr float OneMinusEpsilon = 0x1.fffffep-1;
+
+/// @brief A 64 bit hash with good avalanche behavior (the finalizer of SplitMix64).
+inline uint64_t mixBits(uint64_t v) {
+    v ^= v >> 31;
+    v *= 0x7fb5d329728ea185ull;
+    v ^= v >> 27;
+    v *= 0x81dadef4bc2dd44dull;
+    v ^= v >> 33;
+    return v;
+}
+
+inline uint32_t reverseBits(uint32_t v) {
+    v = (v >> 16) | (v << 16);
+    v = ((v & 0xff00ff00u) >> 8) | ((v & 0x00ff00ffu) << 8);
+    v = ((v & 0xf0f0f0f0u) >> 4) | ((v & 0x0f0f0f0fu) << 4);
+    v = ((v & 0xccccccccu) >> 2) | ((v & 0x33333333u) << 2);
+    v = ((v & 0xaaaaaaaau) >> 1) | ((v & 0x55555555u) << 1);
+    return v;
+}
+
+/// @brief A 32 bit hash with good avalanche behavior ("lowbias32" by Chris Wellons).
+inline uint32_t mixBits32(uint32_t v) {
+    v ^= v >> 16;
+    v *= 0x7feb352du;
+    v ^= v >> 15;
+    v *= 0x846ca68bu;
+    v ^= v >> 16;
+    return v;
+}
+
+/**
+ * @brief Owen scrambles a sample given with its bits reversed, which randomly flips every digit depending on all
+ * digits before it, and converts the result to a float in [0,1). The scrambling is a hash that only propagates
+ * changes from lower to higher bits [Laine and Karras 2011, Burley 2020], hence the reversed bits.
+ */
+inline float owenScrambled(uint32_t reversed, uint32_t seed) {
+    uint32_t v = reversed;
+    v ^= v * 0x3d20adeau;
+    v += seed;
+    v *= (seed >> 16) | 1;
+    v ^= v * 0x05526c56u;
+    v ^= v * 0x53a22864u;
+    return std::min(float(reverseBits(v)) * 0x1p-32f, OneMinusEpsilon);
+}
+
+namespace detail {
+
+/// @brief Multiplies two polynomials over GF(2) (stored as bit masks) modulo a polynomial of the given degree.
+inline uint32_t multiplyModulo(uint32_t a, uint32_t b, uint32_t modulus, int degree) {
+    uint32_t result = 0;
+    for (; b; b >>= 1) {
+        if (b & 1) result ^= a;
+        a <<= 1;
+        if (a >> degree & 1) a ^= modulus;
+    }
+    return result;
+}
+
+/// @brief Whether the polynomial generates all non-zero elements of GF(2^degree), i.e., x has maximal order.
+inline bool isPrimitive(uint32_t polynomial, int degree) {
+    const auto power = [&](uint64_t exponent) {
+        uint32_t result = 1, base = degree > 1 ? 2 : 1;
+        for (; exponent; exponent >>= 1) {
+            if (exponent & 1) result = multiplyModulo(result, base, polynomial, degree);
+            base = multiplyModulo(base, base, polynomial, degree);
+        }
+        return result;
+    };
+
+    const uint64_t order = (uint64_t(1) << degree) - 1;
+    if (power(order) != 1) return false;
+    uint64_t remaining = order;
+    for (uint64_t factor = 2; factor * factor <= remaining; factor++) {
+        if (remaining % factor) continue;
+        if (power(order / factor) == 1) return false;
+        while (remaining % factor == 0) remaining /= factor;
+    }
+    return remaining == 1 || remaining == order || power(order / remaining) != 1;
+}
+
+/**
+ * @brief Builds the generator matrices of all dimensions, each column stored as a 32 bit word, so that a sample is the
+ * xor of the columns selected by the bits of its index. The bits of the columns are stored in reverse order (least
+ * significant bit first), which is the order that Owen scrambling works in (see @ref owenScrambled ).
+ * The first dimension is the van der Corput sequence, and every further dimension is derived from the next primitive
+ * polynomial (in order of degree). The initial direction numbers are odd numbers drawn by a fixed random number
+ * generator, as the Owen scrambling applied on top hides most of the differences between good and bad choices.
+ */
+inline std::vector<uint32_t> computeMatrices() {
+    std::vector<uint32_t> matrices(DimensionCount * MatrixSize, 0);
+    for (int column = 0; column < 32; column++) matrices[column] = 1u << (31 - column);
+
+    pcg32 rng(0x5eed5eedull);
+    int dimension = 1;
+    for (int degree = 1; dimension < DimensionCount; degree++) {
+        // the leading and constant coefficients of a primitive polynomial are always one
+        for (uint32_t inner = 0; inner < (1u << std::max(degree - 1, 0)) && dimension < DimensionCount; inner++) {
+            const uint32_t polynomial = (1u << degree) | (inner << 1) | 1;
+            if (!isPrimitive(polynomial, degree)) continue;
+
+            uint32_t *v = &matrices[dimension * MatrixSize];
+            for (int k = 0; k < degree; k++) {
+                const uint32_t m = (rng.nextUInt(1u << k) << 1) | 1;
+                v[k] = m << (31 - k);
+            }
+            for (int k = degree; k < MatrixSize; k++) {
+                v[k] = v[k - degree] ^ (v[k - degree] >> degree);
+                for (int i = 1; i < degree; i++) {
+                    if (polynomial >> (degree - i) & 1) v[k] ^= v[k - i];
+                }
+            }
+            dimension++;
+        }
+    }
+    for (uint32_t &column : matrices) column = reverseBits(column);
+    return matrices;
+}
+
+}
+
+/// @brief The generator matrices of all dimensions (see @ref detail::computeMatrices ), computed on first use.
+inline const uint32_t *matrices() {
+    static const std::vector<uint32_t> matrices = detail::computeMatrices();
+    return matrices.data();
+}
+
+/// @brief Computes the unscrambled sample (with reversed bits) of the given index in one dimension (given by its generator matrix).
+inline uint32_t sample(const uint32_t *matrix, uint64_t index) {
+    uint32_t v = 0;
+    for (; index; index >>= 1, matrix++) {
+        // selects the column without a branch, as the bits of the index are unpredictable
+        v ^= *matrix & -uint32_t(index & 1);
+    }
+    return v;
+}
+
+}
@@ -0,0 +1,151 @@
+#include <lightwave.hpp>
+#include "sobol.hpp"
+
+#include <array>
+#include <bit>
+
+namespace lightwave {
+
+namespace {
+
+/// @brief Interleaves the bits of the coordinates, which orders the pixels along a Z-shaped space filling curve.
+uint64_t encodeMorton(const Point2i &pixel) {
+    const auto spread = [](uint32_t v) {
+        uint64_t x = v;
+        x = (x | x << 16) & 0x0000ffff0000ffffull;
+        x = (x | x << 8) & 0x00ff00ff00ff00ffull;
+        x = (x | x << 4) & 0x0f0f0f0f0f0f0f0full;
+        x = (x | x << 2) & 0x3333333333333333ull;
+        x = (x | x << 1) & 0x5555555555555555ull;
+        return x;
+    };
+    return spread(uint32_t(pixel.x())) | spread(uint32_t(pixel.y())) << 1;
+}
+
+constexpr std::array<std::array<uint8_t, 4>, 24> computeDigitPermutations() {
+    std::array<std::array<uint8_t, 4>, 24> permutations {};
+    std::array<uint8_t, 4> permutation { 0, 1, 2, 3 };
+    for (auto &p : permutations) {
+        p = permutation;
+        std::next_permutation(permutation.begin(), permutation.end());
+    }
+    return permutations;
+}
+
+/// @brief All permutations of the four digits in base four.
+constexpr std::array<std::array<uint8_t, 4>, 24> DigitPermutations = computeDigitPermutations();
+
+}
+
+/**
+ * @brief Generates a single two dimensional Sobol sequence for the entire image, in which the pixels occupy
+ * consecutive ranges of sample indices in the order of a Morton curve ("ZSobol" [Ahmed and Wonka 2020]).
+ * The samples of neighboring pixels are thus stratified against each other, which distributes the error as blue noise.
+ * Each dimension randomly permutes the base four digits of the sample index (so that pixels are not correlated across
+ * dimensions) and Owen scrambles the samples, which supports any number of dimensions.
+ * @note The sample count is rounded up to a power of two. Samples beyond the sample count (e.g., in adaptive sampling)
+ * continue the sequence of the pixel, but are no longer stratified against neighboring pixels.
+ */
+class ZSobol final : public Sampler {
+    int m_seed;
+    const uint32_t *m_matrices;
+    int m_log2SamplesPerPixel;
+    /// @brief The number of bits of the Morton code of a pixel (twice the logarithm of the rounded up resolution).
+    int m_pixelBits = 32;
+
+    /// @brief The index of the current sample in the sequence of the image (before permuting its digits).
+    uint64_t m_mortonIndex = 0;
+    uint32_t m_dimension = 0;
+
+    /// @brief Applies the random digit permutation of the current dimension to the sample index.
+    uint64_t sampleIndex() const {
+        // with an odd number of bits, the lowest digit is in base two
+        const int odd = m_log2SamplesPerPixel & 1;
+        const int bits = m_pixelBits + m_log2SamplesPerPixel;
+        const uint64_t dimensionHash = 0x55555555ull * m_dimension;
+
+        uint64_t index = m_mortonIndex >> bits << bits;
+        for (int shift = bits - 2; shift >= odd; shift -= 2) {
+            const int digit = int(m_mortonIndex >> shift & 3);
+            const uint64_t higherDigits = m_mortonIndex >> (shift + 2);
+            // a single multiplication suffices to pick one of the permutations, as only the highest bits are used
+            const uint32_t hash = uint32_t((higherDigits ^ dimensionHash) * 0x9e3779b97f4a7c15ull >> 32);
+            const int permutation = int(uint64_t(hash) * 24 >> 32);
+            index |= uint64_t(DigitPermutations[permutation][digit]) << shift;
+        }
+        if (odd) {
+            index |= (m_mortonIndex & 1) ^ (sobol::mixBits((m_mortonIndex >> 1) ^ dimensionHash) & 1);
+        }
+        return index;
+    }
+
+    uint64_t dimensionHash() const {
+        return sobol::mixBits(uint64_t(m_dimension) << 32 ^ uint32_t(m_seed));
+    }
+
+public:
+    ZSobol(const Properties &properties) : Sampler(properties) {
+        m_seed = properties.get<int>("seed", 1337);
+        m_matrices = sobol::matrices();
+        if (!std::has_single_bit(uint32_t(m_samplesPerPixel))) {
+            const int rounded = int(std::bit_ceil(uint32_t(m_samplesPerPixel)));
+            logger(EWarn, "zsobol sampler rounds sample count %d up to %d", m_samplesPerPixel, rounded);
+            m_samplesPerPixel = rounded;
+        }
+        m_log2SamplesPerPixel = std::countr_zero(uint32_t(m_samplesPerPixel));
+    }
+
+    void setResolution(const Vector2i &resolution) override {
+        const uint32_t size = uint32_t(std::max(resolution.x(), resolution.y()));
+        m_pixelBits = 2 * std::countr_zero(std::bit_ceil(size));
+    }
+
+    void seed(int sampleIndex) override {
+        m_mortonIndex = uint32_t(sampleIndex);
+        m_dimension = 0;
+    }
+
+    void seed(const Point2i &pixel, int sampleIndex) override {
+        const uint64_t mask = (uint64_t(1) << m_log2SamplesPerPixel) - 1;
+        // samples beyond the sample count are placed above all pixels, which keeps the indices unique
+        m_mortonIndex = encodeMorton(pixel) << m_log2SamplesPerPixel | (uint64_t(sampleIndex) & mask) |
+                        (uint64_t(sampleIndex) >> m_log2SamplesPerPixel) << (m_pixelBits + m_log2SamplesPerPixel);
+        m_dimension = 0;
+    }
+
+    float next() override {
+        const uint64_t index = sampleIndex();
+        m_dimension++;
+        // the first dimension of the Sobol sequence is the van der Corput sequence, i.e., the index with reversed bits
+        return sobol::owenScrambled(uint32_t(index), uint32_t(dimensionHash()));
+    }
+
+    Point2 next2D() override {
+        const uint64_t index = sampleIndex();
+        m_dimension += 2;
+        const uint64_t hash = dimensionHash();
+        return {
+            sobol::owenScrambled(uint32_t(index), uint32_t(hash)),
+            sobol::owenScrambled(sobol::sample(m_matrices + sobol::MatrixSize, index), uint32_t(hash >> 32)),
+        };
+    }
+
+    ref<Sampler> clone() const override {
+        return std::make_shared<ZSobol>(*this);
+    }
+
+    std::string toString() const override {
+        return tfm::format(
+            "ZSobol[\n"
+            "  count = %d,\n"
+            "  seed = %d\n"
+            "]",
+            m_samplesPerPixel,
+            m_seed
+        );
+    }
+};
+
+}
+
+REGISTER_SAMPLER(ZSobol, "zsobol")
@@ -4,6 +4,7 @@
 #include <lightwave/math.hpp>
 #include <lightwave/shape.hpp>
 
+#include <bit>
 #include <numeric>
 
 namespace lightwave {
@@ -140,6 +141,83 @@ class AccelerationStructure : public Shape {
         return wasIntersected;
     }
 
+    /// @brief Packets with fewer active rays than this are traversed ray by
+    /// ray, as packet traversal no longer pays off once rays have diverged.
+    static constexpr int MinimumPacketSize = 4;
+
+    /**
+     * @brief Determines which rays of a packet need to visit a node. Rays are
+     * tested in order until the first one hits the bounding box, at which
+     * point all remaining rays descend speculatively (for coherent packets,
+     * this saves testing every ray against every node). If the first ray
+     * misses, the interval bounds of the packet are used to cull the node for
+     * all rays at once.
+     */
+    RayPacket::Mask cullPacket(const Bounds &bounds, const RayPacket &packet,
+                               RayPacket::Mask mask,
+                               const Intersection *its) const {
+        bool testedInterval = false;
+        for (RayPacket::Mask m = mask; m; m &= m - 1) {
+            const int i = std::countr_zero(m);
+            if (intersectAABB(bounds, packet.rays[i]) < its[i].t)
+                return m; // rays before i are known to miss
+            if (!testedInterval) {
+                if (!packet.mayIntersect(bounds))
+                    return 0;
+                testedInterval = true;
+            }
+        }
+        return 0;
+    }
+
+    /**
+     * @brief Intersects a BVH node with all active rays of a packet. Children
+     * are visited in the order they are hit by the first active ray, and
+     * traversal falls back to @ref intersectNode once too few rays remain.
+     */
+    RayPacket::Mask intersectNodePacket(const Node &node,
+                                        const RayPacket &packet,
+                                        RayPacket::Mask mask,
+                                        Intersection *its) const {
+        RayPacket::Mask hits = 0;
+        if (std::popcount(mask) < MinimumPacketSize) {
+            for (RayPacket::Mask m = mask; m; m &= m - 1) {
+                const int i = std::countr_zero(m);
+                if (intersectAABB(node.aabb, packet.rays[i]) < its[i].t &&
+                    intersectNode(node, packet.rays[i], its[i],
+                                  *packet.rng[i]))
+                    hits |= RayPacket::Mask(1) << i;
+            }
+            return hits;
+        }
+
+        for (RayPacket::Mask m = mask; m; m &= m - 1)
+            its[std::countr_zero(m)].stats.bvhCounter++;
+
+        if (node.isLeaf()) {
+            for (NodeIndex i = 0; i < node.primitiveCount; i++) {
+                for (RayPacket::Mask m = mask; m; m &= m - 1)
+                    its[std::countr_zero(m)].stats.primCounter++;
+                hits |= intersectPacket(m_primitiveIndices[node.leftFirst + i],
+                                        packet, mask, its);
+            }
+            return hits;
+        }
+
+        const Node *nearChild = &m_nodes[node.leftChildIndex()];
+        const Node *farChild  = &m_nodes[node.rightChildIndex()];
+        const Ray &leadingRay = packet.rays[std::countr_zero(mask)];
+        if (intersectAABB(farChild->aabb, leadingRay) <
+            intersectAABB(nearChild->aabb, leadingRay))
+            std::swap(nearChild, farChild);
+
+        for (const Node *child : { nearChild, farChild }) {
+            if (const auto childMask = cullPacket(child->aabb, packet, mask, its))
+                hits |= intersectNodePacket(*child, packet, childMask, its);
+        }
+        return hits;
+    }
+
     /// @brief Performs a slab test to intersect a bounding box with a ray,
     /// returning Infinity in case the ray misses.
     float intersectAABB(const Bounds &bounds, const Ray &ray) const {
@@ -358,6 +436,21 @@ protected:
     /// ray.
     virtual bool intersect(int primitiveIndex, const Ray &ray,
                            Intersection &its, Sampler &rng) const = 0;
+    /// @brief Intersect a single child (identified by the index) with the
+    /// active rays of a packet. By default, the rays are intersected one by one.
+    virtual RayPacket::Mask intersectPacket(int primitiveIndex,
+                                            const RayPacket &packet,
+                                            RayPacket::Mask mask,
+                                            Intersection *its) const {
+        RayPacket::Mask hits = 0;
+        for (RayPacket::Mask m = mask; m; m &= m - 1) {
+            const int i = std::countr_zero(m);
+            if (intersect(primitiveIndex, packet.rays[i], its[i],
+                          *packet.rng[i]))
+                hits |= RayPacket::Mask(1) << i;
+        }
+        return hits;
+    }
     /// @brief Returns the axis aligned bounding box of the given child.
     virtual Bounds getBoundingBox(int primitiveIndex) const = 0;
     /// @brief Returns the centroid of the given child.
@@ -394,6 +487,16 @@ public:
         return false;
     }
 
+    RayPacket::Mask intersectPacket(const RayPacket &packet,
+                                    RayPacket::Mask mask,
+                                    Intersection *its) const override {
+        if (m_primitiveIndices.empty())
+            return 0; // exit early if no children exist
+        if (const auto rootMask = cullPacket(rootNode().aabb, packet, mask, its))
+            return intersectNodePacket(rootNode(), packet, rootMask, its);
+        return 0;
+    }
+
     Bounds getBoundingBox() const override { return rootNode().aabb; }
 
     Point getCentroid() const override { return rootNode().aabb.center(); }
@@ -11,6 +11,8 @@ namespace lightwave {
  */
 class Group final : public AccelerationStructure {
     std::vector<ref<Shape>> m_children;
+    /// @brief Whether the group is sampled by an area light, in which case intersections report the density of sampleArea.
+    bool m_isLightSource = false;
 
 protected:
     int numberOfPrimitives() const override {
@@ -18,7 +20,21 @@ protected:
     }
 
     bool intersect(int primitiveIndex, const Ray &ray, Intersection &its, Sampler &rng) const override {
-        return m_children[primitiveIndex]->intersect(ray, its, rng);
+        if (!m_children[primitiveIndex]->intersect(ray, its, rng)) return false;
+        // children are picked uniformly by sampleArea, which the area pdf of the hit needs to account for
+        if (m_isLightSource) its.pdf /= m_children.size();
+        return true;
+    }
+
+    RayPacket::Mask intersectPacket(int primitiveIndex, const RayPacket &packet, RayPacket::Mask mask,
+                                    Intersection *its) const override {
+        const RayPacket::Mask hits = m_children[primitiveIndex]->intersectPacket(packet, mask, its);
+        if (m_isLightSource) {
+            for (RayPacket::Mask m = hits; m; m &= m - 1) {
+                its[std::countr_zero(m)].pdf /= m_children.size();
+            }
+        }
+        return hits;
     }
 
     Bounds getBoundingBox(int primitiveIndex) const override {
@@ -39,6 +55,11 @@ public:
         for (auto &child : m_children) child->markAsVisible();
     }
 
+    void markAsLightSource() override {
+        m_isLightSource = true;
+        for (auto &child : m_children) child->markAsLightSource();
+    }
+
     AreaSample sampleArea(Sampler &rng) const override {
         int childIndex = int(rng.next() * m_children.size());
         childIndex = std::min(childIndex, int(m_children.size()) - 1);
@@ -48,6 +69,15 @@ public:
         return sample;
     }
 
+    AreaSample sampleArea(const Point &origin, Sampler &rng) const override {
+        int childIndex = int(rng.next() * m_children.size());
+        childIndex = std::min(childIndex, int(m_children.size()) - 1);
+
+        AreaSample sample = m_children[childIndex]->sampleArea(origin, rng);
+        sample.pdf /= m_children.size();
+        return sample;
+    }
+
     std::string toString() const override {
         std::stringstream oss;
         oss << "Group[" << std::endl;
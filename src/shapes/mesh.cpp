@@ -28,6 +28,43 @@ class TriangleMesh : public AccelerationStructure {
     std::filesystem::path m_originalPath;
     /// @brief Whether to interpolate the normals from m_vertices, or report the geometric normal instead.
     bool m_smoothNormals;
+    /// @brief Picks triangles in proportion to their area, which makes area sampling of the mesh uniform.
+    AliasTable m_triangleAreas;
+
+    /**
+     * @brief Constructs a surface event for a point on a triangle, used by @ref intersect to populate the
+     * @ref Intersection and by @ref sampleArea to populate the @ref AreaSample .
+     * @param surf The surface event to populate with position, texture coordinates, shading frame and area pdf
+     * @param primitiveIndex The index of the triangle
+     * @param bary The barycentric coordinates of the point (weights of the second and third vertex)
+     */
+    inline void populate(SurfaceEvent &surf, int primitiveIndex, const Vector2 &bary) const {
+        const Vector3i triangle = m_triangles[primitiveIndex];
+        const Vertex &v0 = m_vertices[triangle[0]];
+        const Vertex &v1 = m_vertices[triangle[1]];
+        const Vertex &v2 = m_vertices[triangle[2]];
+
+        Vertex vtx = Vertex::interpolate(bary, v0, v1, v2);
+        surf.uv = vtx.texcoords;
+        surf.position = vtx.position;
+
+        Vector normal = (v1.position - v0.position).cross(v2.position - v0.position);
+        // the ratio of the areas the triangle covers in texture space and in space
+        const Vector2 duv1 = v1.texcoords - v0.texcoords;
+        const Vector2 duv2 = v2.texcoords - v0.texcoords;
+        surf.uvScale = safe_sqrt(abs(duv1.x() * duv2.y() - duv1.y() * duv2.x()) / normal.length());
+
+        //smooth normal 
+        if(m_smoothNormals){
+            normal = vtx.normal;
+        }
+
+        surf.frame.normal = normal.normalized();
+        surf.frame = Frame(surf.frame.normal);
+
+        // triangles are picked in proportion to their area and sampled uniformly, hence the pdf is 1/surfaceArea
+        surf.pdf = 1 / m_triangleAreas.total();
+    }
 
 protected:
     int numberOfPrimitives() const override {
@@ -90,22 +127,7 @@ protected:
         if (t >= Epsilon && t <its.t ) {
             //update its.t/uv/frame/position/pdf
             its.t = t;
-            
-            Vertex vtx = m_vertices[triangle[0]].interpolate(Vector2(u,v), m_vertices[triangle[0]], m_vertices[triangle[1]], m_vertices[triangle[2]]);
-            its.uv = vtx.texcoords;
-            its.position = vtx.position;
-
-            Vector normal;
-            normal = edge1.cross(edge2);
-
-            //smooth normal 
-            if(m_smoothNormals){
-                normal = vtx.normal;
-            }
-
-            its.frame.normal = normal.normalized();
-            its.frame = Frame(its.frame.normal);
-            
+            populate(its, primitiveIndex, Vector2(u,v)); // same as sampleArea
 
             return true;
             
@@ -142,11 +164,27 @@ public:
             m_vertices.size()
         );
         buildAccelerationStructure();
+
+        std::vector<float> areas(m_triangles.size());
+        for (int i = 0; i < int(m_triangles.size()); i++) {
+            const Vector3i triangle = m_triangles[i];
+            const Point &p0 = m_vertices[triangle[0]].position;
+            areas[i] = (m_vertices[triangle[1]].position - p0).cross(m_vertices[triangle[2]].position - p0).length() / 2;
+        }
+        m_triangleAreas = AliasTable(areas);
     }
 
     AreaSample sampleArea(Sampler &rng) const override {
-        // only implement this if you need triangle mesh area light sampling for your rendering competition
-        NOT_IMPLEMENTED
+        if (!(m_triangleAreas.total() > 0)) return AreaSample::invalid();
+
+        // the random number is remapped after picking a triangle, so that it can be reused for the barycentrics
+        float remapped;
+        const int primitiveIndex = m_triangleAreas.sample(rng.next(), remapped);
+        const Vector2 bary = squareToUniformTriangle(Point2(remapped, rng.next()));
+
+        AreaSample sample;
+        populate(sample, primitiveIndex, bary); // compute the shading frame, texture coordinates and area pdf (same as intersection)
+        return sample;
     }
 
     std::string toString() const override {
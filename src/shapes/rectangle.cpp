@@ -16,6 +16,7 @@ class Rectangle : public Shape {
         // map the position from [-1,-1,0]..[+1,+1,0] to [0,0]..[1,1] by discarding the z component and rescaling
         surf.uv.x() = (position.x() + 1) / 2;
         surf.uv.y() = (position.y() + 1) / 2;
+        surf.uvScale = 0.5f;
 
         // the tangent always points in positive x direction
         surf.frame.tangent = Vector(1, 0, 0);
@@ -28,6 +29,41 @@ class Rectangle : public Shape {
         surf.pdf = 1.0f / 4;
     }
 
+    /**
+     * @brief Returns the solid angle the rectangle covers as seen from @c origin , or zero if it is too small or too
+     * large to be sampled robustly by @ref sampleArea (in which case the area is sampled uniformly instead).
+     */
+    inline float sphericalSolidAngle(const Point &origin) const {
+        // the solid angle of the two triangles (a,b,c) and (a,c,d), using the formula by Van Oosterom and Strackee
+        const Vector a = Point(-1, -1, 0) - origin;
+        const Vector b = Point(+1, -1, 0) - origin;
+        const Vector c = Point(+1, +1, 0) - origin;
+        const Vector d = Point(-1, +1, 0) - origin;
+        const float la = a.length(), lb = b.length(), lc = c.length(), ld = d.length();
+        const float triple = std::abs(a.dot(b.cross(c)));
+        const float solidAngle =
+            2 * std::atan2(triple, la * lb * lc + a.dot(b) * lc + a.dot(c) * lb + b.dot(c) * la) +
+            2 * std::atan2(triple, la * lc * ld + a.dot(c) * ld + a.dot(d) * lc + c.dot(d) * la);
+
+        // tiny solid angles suffer from cancellation, while solid angles close to a hemisphere are numerically unstable
+        if (solidAngle < 3e-4f || solidAngle > 6.22f) return 0;
+        return solidAngle;
+    }
+
+    /**
+     * @brief Returns the area density with which @ref sampleArea picks a given surface point for illuminating @c origin ,
+     * i.e., the uniform density over the solid angle of the rectangle, converted to area measure.
+     */
+    inline float areaPdf(const Point &origin, const SurfaceEvent &surf) const {
+        const float solidAngle = sphericalSolidAngle(origin);
+        if (solidAngle == 0) return 1.0f / 4;
+
+        const Vector toSurface = surf.position - origin;
+        const float distanceSquared = toSurface.lengthSquared();
+        const float cosSurface = std::abs(toSurface.z()) / std::sqrt(distanceSquared);
+        return cosSurface / (solidAngle * distanceSquared);
+    }
+
 public:
     Rectangle(const Properties &properties) {
     }
@@ -56,6 +92,7 @@ public:
         // we have determined there was an intersection! we are now free to change the intersection object and return true.
         its.t = t;
         populate(its, position); // compute the shading frame, texture coordinates and area pdf (same as sampleArea)
+        its.pdf = areaPdf(ray.origin, its); // the density of sampling this point for the origin of the ray (same as sampleArea)
         
         return true;
     }
@@ -77,6 +114,58 @@ public:
         return sample;
     }
 
+    AreaSample sampleArea(const Point &origin, Sampler &rng) const override {
+        const float solidAngle = sphericalSolidAngle(origin);
+        if (solidAngle == 0) return sampleArea(rng);
+
+        // sample the spherical rectangle uniformly, see "An Area-Preserving Parametrization for Spherical Rectangles"
+        // [Urena et al. 2013]; we work in a frame centered at the origin whose z axis points away from the rectangle
+        const float x0 = -1 - origin.x(), x1 = +1 - origin.x();
+        const float y0 = -1 - origin.y(), y1 = +1 - origin.y();
+        const float z0 = -std::abs(origin.z());
+
+        // the normals of the planes through the origin and the edges of the rectangle, and the internal angles
+        const Vector v00 { x0, y0, z0 }, v01 { x0, y1, z0 }, v10 { x1, y0, z0 }, v11 { x1, y1, z0 };
+        const Vector n0 = v00.cross(v10).normalized();
+        const Vector n1 = v10.cross(v11).normalized();
+        const Vector n2 = v11.cross(v01).normalized();
+        const Vector n3 = v01.cross(v00).normalized();
+        const float g0 = safe_acos(-n0.dot(n1));
+        const float g1 = safe_acos(-n1.dot(n2));
+        const float g2 = safe_acos(-n2.dot(n3));
+        const float g3 = safe_acos(-n3.dot(n0));
+        const float b0 = n0.z(), b1 = n2.z();
+        const float k = 2 * Pi - g2 - g3;
+        const float area = g0 + g1 - k;
+
+        // first pick the x coordinate such that the partial solid angle is uniformly distributed ...
+        const Point2 rnd = rng.next2D();
+        const float au = rnd.x() * area + k;
+        const float fu = (std::cos(au) * b0 - b1) / std::sin(au);
+        float cu = std::copysign(1 / std::sqrt(sqr(fu) + sqr(b0)), fu);
+        cu = clamp(cu, -1, +1);
+        float xu = -(cu * z0) / safe_sqrt(1 - sqr(cu));
+        xu = clamp(xu, x0, x1);
+
+        // ... then the y coordinate along the resulting line, uniformly in the cosine of its angle
+        const float d = std::sqrt(sqr(xu) + sqr(z0));
+        const float h0 = y0 / std::sqrt(sqr(d) + sqr(y0));
+        const float h1 = y1 / std::sqrt(sqr(d) + sqr(y1));
+        const float hv = h0 + rnd.y() * (h1 - h0);
+        const float yv = sqr(hv) < 1 - Epsilon ? (hv * d) / std::sqrt(1 - sqr(hv)) : y1;
+
+        const Point position {
+            clamp(origin.x() + xu, -1, +1),
+            clamp(origin.y() + yv, -1, +1),
+            0,
+        };
+
+        AreaSample sample;
+        populate(sample, position);
+        sample.pdf = areaPdf(origin, sample);
+        return sample;
+    }
+
     std::string toString() const override {
         return "Rectangle[]";
     }
@@ -17,6 +17,10 @@ class Sphere : public Shape {
         // phi = acos(position.y())
         surf.uv.x() = atan2(position.z(), position.x()) / (2 * Pi);     // z, x
         surf.uv.y() = asin(position.y()) / Pi;                          // asin
+        // u wraps around each circle of latitude, v spans half of a great circle; both are averaged geometrically
+        // (the circles of latitude shrink towards the poles, where the scale is limited to stay finite)
+        const float latitudeRadius = std::max(safe_sqrt(1 - sqr(position.y())), 1e-3f);
+        surf.uvScale = 1 / (Pi * radius * sqrt(2 * latitudeRadius));
 
         // define vector
         surf.frame.normal = (position - center).normalized();
@@ -26,6 +30,38 @@ class Sphere : public Shape {
         surf.pdf = 1.0f / (4 * Pi * pow(radius, 2));
     }
 
+    /**
+     * @brief Returns one minus the cosine of the half-angle of the cone that the sphere subtends as seen from
+     * @c origin , or zero if the origin lies within the sphere (in which case the area is sampled uniformly).
+     * @param sin2ThetaMax Receives the squared sine of the half-angle of the cone.
+     */
+    inline float coneOneMinusCos(const Point &origin, float &sin2ThetaMax) const {
+        const float distanceSquared = (center - origin).lengthSquared();
+        // points on the surface itself (e.g., when the sphere is shaded) are treated like points within the sphere,
+        // as the cone would otherwise degenerate into the tangent plane
+        if (distanceSquared <= sqr(radius) * (1 + Epsilon)) return 0;
+
+        sin2ThetaMax = sqr(radius) / distanceSquared;
+        // for small cones, 1 - cos(theta) suffers from cancellation and is better approximated by its taylor expansion
+        if (sin2ThetaMax < 0.00068523f /* sin^2(1.5 deg) */) return sin2ThetaMax / 2;
+        return 1 - safe_sqrt(1 - sin2ThetaMax);
+    }
+
+    /**
+     * @brief Returns the area density with which @ref sampleArea picks a given surface point for illuminating @c origin ,
+     * i.e., the uniform density over the cone the sphere subtends, converted to area measure.
+     */
+    inline float areaPdf(const Point &origin, const SurfaceEvent &surf) const {
+        float sin2ThetaMax;
+        const float oneMinusCosThetaMax = coneOneMinusCos(origin, sin2ThetaMax);
+        if (oneMinusCosThetaMax == 0) return 1.0f / (4 * Pi * pow(radius, 2));
+
+        const Vector toSurface = surf.position - origin;
+        const float distanceSquared = toSurface.lengthSquared();
+        const float cosSurface = std::abs(surf.frame.normal.dot(toSurface)) / std::sqrt(distanceSquared);
+        return cosSurface / (2 * Pi * oneMinusCosThetaMax * distanceSquared);
+    }
+
 public:
     Point center = Point(0);
     float radius = 1.0f;
@@ -90,6 +126,8 @@ public:
         // its.frame.normal = (its.position - center).normalized();
         // its.frame = Frame(its.frame.normal);
         populate(its, its.position);
+        // report the density of sampling this point for the origin of the ray, as needed by area lights
+        its.pdf = areaPdf(ray.origin, its);
 
         return true;
     }
@@ -108,6 +146,34 @@ public:
         populate(sample, position);
         return sample;
     }
+    AreaSample sampleArea(const Point &origin, Sampler &rng) const override {
+        float sin2ThetaMax;
+        const float oneMinusCosThetaMax = coneOneMinusCos(origin, sin2ThetaMax);
+        // points within the sphere see all of its surface, hence we sample its area uniformly
+        if (oneMinusCosThetaMax == 0) return sampleArea(rng);
+
+        // sample a direction uniformly within the cone towards the sphere (see "Physically Based Rendering", 4th ed.)
+        const Point2 rnd = rng.next2D();
+        const float sinThetaMax = std::sqrt(sin2ThetaMax);
+        const float cosTheta = 1 - rnd.x() * oneMinusCosThetaMax;
+        const float sin2Theta = sin2ThetaMax < 0.00068523f ? sin2ThetaMax * rnd.x() : 1 - sqr(cosTheta);
+
+        // instead of intersecting the sphere with the sampled direction, find the angle between the direction
+        // towards the origin and the normal at the hit point as seen from the center of the sphere
+        const float cosAlpha = sin2Theta / sinThetaMax +
+            std::sqrt(1 - sin2Theta) * safe_sqrt(1 - sin2Theta / sin2ThetaMax);
+        const float sinAlpha = safe_sqrt(1 - sqr(cosAlpha));
+        const float phi = 2 * Pi * rnd.y();
+
+        const Frame frame((center - origin).normalized());
+        const Vector normal = frame.toWorld({ sinAlpha * std::cos(phi), sinAlpha * std::sin(phi), -cosAlpha });
+        const Point position = center + radius * normal;
+
+        AreaSample sample;
+        populate(sample, position);
+        sample.pdf = areaPdf(origin, sample);
+        return sample;
+    }
     std::string toString() const override {
         return "Sphere[]";
     }
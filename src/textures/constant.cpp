@@ -2,7 +2,7 @@
 
 namespace lightwave {
 
-class ConstantTexture : public Texture {
+class ConstantTexture final : public Texture {
     Color m_value;
 
 public:
@@ -12,6 +12,8 @@ public:
 
     Color evaluate(const Point2 &uv) const override { return m_value; }
 
+    std::optional<Color> constant() const override { return m_value; }
+
     std::string toString() const override {
         return tfm::format("ConstantTexture[\n"
                            "  value = %s\n"
@@ -1,7 +1,16 @@
 #include <lightwave.hpp>
+#include "tiled.hpp"
 
 namespace lightwave {
 
+/**
+ * @brief A texture given by an image, looked up with nearest neighbor or bilinear interpolation.
+ * In the (default) trilinear filter mode, the image is additionally prefiltered into a pyramid of successively halved
+ * resolutions ("mip map" [Williams 1983]). Filtered lookups (see @ref Texture::evaluateFiltered ) then interpolate
+ * between the two levels whose texels are closest in size to the footprint of the ray, which avoids aliasing of
+ * distant textures and keeps their lookups within small, cache friendly levels.
+ * The texels of all levels are stored in blocks of @c blockSize x @c blockSize texels (see @ref TiledImage ).
+ */
 class ImageTexture : public Texture {
     enum class BorderMode {
         Clamp,
@@ -11,19 +20,48 @@ class ImageTexture : public Texture {
     enum class FilterMode {
         Nearest,
         Bilinear,
+        Trilinear,
     };
 
-    ref<Image> m_image;
     float m_exposure;
     BorderMode m_border;
     FilterMode m_filter;
+    /// @brief The side length of the blocks the texels are stored in (one for row-major order).
+    int m_blockSize;
+    /// @brief The levels of the mip map, starting with the image itself (the only level unless filtering trilinearly).
+    std::vector<TiledImage> m_pyramid;
+
+    /// @brief Halves the resolution of an image by averaging blocks of two by two texels (in parallel over rows).
+    static ref<Image> downsample(const Image &image) {
+        const Point2i res = image.resolution();
+        auto result = std::make_shared<Image>(Point2i(std::max(res.x() / 2, 1), std::max(res.y() / 2, 1)));
+        const Point2i resultRes = result->resolution();
+        for_each_parallel(ChunkedRange(resultRes.y(), 16), [&](Range rows) {
+            for (int y : rows) {
+                // images with odd resolution fold their last row or column into the texels before
+                const int y0 = std::min(2 * y, res.y() - 1);
+                const int y1 = y == resultRes.y() - 1 ? res.y() - 1 : std::min(2 * y + 1, res.y() - 1);
+                for (int x = 0; x < resultRes.x(); x++) {
+                    const int x0 = std::min(2 * x, res.x() - 1);
+                    const int x1 = x == resultRes.x() - 1 ? res.x() - 1 : std::min(2 * x + 1, res.x() - 1);
+                    Color sum;
+                    for (int yy = y0; yy <= y1; yy++) {
+                        for (int xx = x0; xx <= x1; xx++) sum += image(Point2i(xx, yy));
+                    }
+                    (*result)(Point2i(x, y)) = sum / float((x1 - x0 + 1) * (y1 - y0 + 1));
+                }
+            }
+        });
+        return result;
+    }
 
 public:
     ImageTexture(const Properties &properties) {
+        ref<Image> image;
         if (properties.has("filename")) {
-            m_image = std::make_shared<Image>(properties);
+            image = std::make_shared<Image>(properties);
         } else {
-            m_image = properties.getChild<Image>();
+            image = properties.getChild<Image>();
         }
         m_exposure = properties.get<float>("exposure", 1);
 
@@ -35,17 +73,34 @@ public:
                                            });
 
         m_filter = properties.getEnum<FilterMode>(
-            "filter", FilterMode::Bilinear,
+            "filter", FilterMode::Trilinear,
             {
                 { "nearest", FilterMode::Nearest },
                 { "bilinear", FilterMode::Bilinear },
+                { "trilinear", FilterMode::Trilinear },
             });
+
+        // blocks of 4x4 texels span three cache lines, and a bilinear lookup mostly falls into one of them
+        m_blockSize = properties.get<int>("blockSize", 4);
+        if (!std::has_single_bit(unsigned(m_blockSize)) || m_blockSize > (1 << TiledImage::MaxLog2BlockSize)) {
+            lightwave_throw("the block size of image textures must be 1, 2, 4 or 8, but is %d", m_blockSize);
+        }
+        const int log2BlockSize = std::countr_zero(unsigned(m_blockSize));
+
+        // the image itself is not kept, all lookups go through the tiled copy
+        m_pyramid.emplace_back(*image, log2BlockSize);
+        if (m_filter == FilterMode::Trilinear) {
+            for (ref<Image> level = image; level->resolution() != Point2i(1);) {
+                level = downsample(*level);
+                m_pyramid.emplace_back(*level, log2BlockSize);
+            }
+        }
     }
 
-    Point2 remapPixel(const Point2 &uv, bool isClamp=true) const {
+    Point2 remapPixel(const Point2 &uv, const Point2i &res, bool isClamp=true) const {
         Point2 edgeMargin {
-            0.5f/m_image->resolution().x(),
-            0.5f/m_image->resolution().y()
+            0.5f/res.x(),
+            0.5f/res.y()
         };
         
         // assume clamp as default
@@ -68,13 +123,13 @@ public:
         return uvOut;
     }
 
-    Color interpolateColor(Point2 &uv, bool isBilinearFiltering) const {
-        Point2i res = m_image->resolution();
+    Color interpolateColor(const TiledImage &image, Point2 &uv, bool isBilinearFiltering) const {
+        Point2i res = image.resolution();
         
         // nearest neighboor
         if (!isBilinearFiltering) {
             // reverse the y ratio
-            return m_image->operator()(Point2{uv.x(), 1.f-uv.y()});
+            return image(Point2{uv.x(), 1.f-uv.y()});
         } else {
             // bilinear method
             // not yet structured for easy access
@@ -91,10 +146,10 @@ public:
 
             // Find the colors of neighbooring pixels position, then extract colors for each position
             // also reverse the position(s) in y
-            Color c00 = Color(m_image->get(Point2i{floorPt.x(), (res.y()-1)-floorPt.y()}));
-            Color c10 = Color(m_image->get(Point2i{ceilPt.x(),  (res.y()-1)-floorPt.y()}));
-            Color c01 = Color(m_image->get(Point2i{floorPt.x(), (res.y()-1)-ceilPt.y()}));
-            Color c11 = Color(m_image->get(Point2i{ceilPt.x(),  (res.y()-1)-ceilPt.y()}));
+            Color c00 = Color(image.get(Point2i{floorPt.x(), (res.y()-1)-floorPt.y()}));
+            Color c10 = Color(image.get(Point2i{ceilPt.x(),  (res.y()-1)-floorPt.y()}));
+            Color c01 = Color(image.get(Point2i{floorPt.x(), (res.y()-1)-ceilPt.y()}));
+            Color c11 = Color(image.get(Point2i{ceilPt.x(),  (res.y()-1)-ceilPt.y()}));
 
             // interpolate the neighbooring pixels
             Color f_y1 = c00 * (1.f - (uv_pixel.x()-floor(uv_pixel.x()))) + c10 * ((uv_pixel.x()-floor(uv_pixel.x())) - 0.f);
@@ -109,18 +164,44 @@ public:
             return Color(0);
         }
         // remap the uv
-        Point2 uvRemapped = remapPixel(uv, m_border == BorderMode::Clamp);
+        Point2 uvRemapped = remapPixel(uv, m_pyramid[0].resolution(), m_border == BorderMode::Clamp);
         // get the pixel volor based on the interpolation
-        Color pixelColor = interpolateColor(uvRemapped, m_filter == FilterMode::Bilinear);    
+        Color pixelColor = interpolateColor(m_pyramid[0], uvRemapped, m_filter != FilterMode::Nearest);    
         return pixelColor;
     }
 
+    Color evaluateFiltered(const Point2 &uv, float footprint) const override {
+        if (m_pyramid.size() == 1 || !(footprint > 0)) return evaluate(uv);
+        // the level whose texels are as wide as the footprint (measured along the longer side of the image)
+        const Point2i res = m_pyramid[0].resolution();
+        const float level = std::log2(footprint * float(std::max(res.x(), res.y())));
+        if (!(level > 0)) return evaluate(uv);
+        if (std::isnan(uv.x()) || std::isnan(uv.y())) return Color(0);
+
+        const auto lookup = [&](int index) {
+            const TiledImage &image = m_pyramid[std::min(index, int(m_pyramid.size()) - 1)];
+            Point2 uvRemapped = remapPixel(uv, image.resolution(), m_border == BorderMode::Clamp);
+            return interpolateColor(image, uvRemapped, true);
+        };
+        const int lower = int(level);
+        if (lower >= int(m_pyramid.size()) - 1) return lookup(lower);
+        const float t = level - lower;
+        return (1 - t) * lookup(lower) + t * lookup(lower + 1);
+    }
+
+    Point2i resolution() const override {
+        return m_pyramid[0].resolution();
+    }
+
     std::string toString() const override {
         return tfm::format("ImageTexture[\n"
-                           "  image = %s,\n"
+                           "  resolution = %dx%d,\n"
+                           "  levels = %d,\n"
+                           "  blockSize = %d,\n"
                            "  exposure = %f,\n"
                            "]",
-                           indent(m_image), m_exposure);
+                           m_pyramid[0].resolution().x(), m_pyramid[0].resolution().y(), m_pyramid.size(),
+                           m_blockSize, m_exposure);
     }
 };
 
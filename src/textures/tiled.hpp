@@ -0,0 +1,212 @@
+/**
+ * @brief The texel storage of image textures, which keeps neighboring texels close together in memory and stores
+ * them with no more precision than their source provides.
+ * @file tiled.hpp
+ */
+
+#pragma once
+
+#include <lightwave/color.hpp>
+#include <lightwave/image.hpp>
+
+#include <algorithm>
+#include <array>
+#include <bit>
+#include <cmath>
+#include <vector>
+
+namespace lightwave {
+
+/**
+ * @brief Converts a float to a half precision float (rounding to the nearest value, and overflowing to infinity)
+ * [Giesen 2012, "float_to_half_fast3"].
+ */
+inline uint16_t floatToHalf(float value) {
+    const uint32_t bits = std::bit_cast<uint32_t>(value);
+    const uint32_t sign = bits >> 16 & 0x8000;
+    uint32_t magnitude = bits & 0x7fffffff;
+    if (magnitude >= 0x47800000) {
+        // too large for a half (65520 and above), infinity or nan
+        return uint16_t(sign | (magnitude > 0x7f800000 ? 0x7e00 : 0x7c00));
+    }
+    if (magnitude < 0x38800000) {
+        // denormal halves, adding 0.5 lets the float addition round the mantissa at the right bit
+        magnitude = std::bit_cast<uint32_t>(std::bit_cast<float>(magnitude) + 0.5f) - 0x3f000000;
+        return uint16_t(sign | magnitude);
+    }
+    // rebias the exponent and round the mantissa to nearest even
+    magnitude += (uint32_t(15 - 127) << 23) + 0xfff + (magnitude >> 13 & 1);
+    return uint16_t(sign | magnitude >> 13);
+}
+
+/// @brief Converts a half precision float to a float [Giesen 2012, "half_to_float"].
+inline float halfToFloat(uint16_t half) {
+    constexpr uint32_t ShiftedExponent = 0x7c00 << 13;
+    uint32_t bits = uint32_t(half & 0x7fff) << 13;
+    const uint32_t exponent = bits & ShiftedExponent;
+    bits += uint32_t(127 - 15) << 23;
+    if (exponent == ShiftedExponent) {
+        // infinity or nan
+        bits += uint32_t(128 - 16) << 23;
+    } else if (exponent == 0) {
+        // denormal halves are renormalized by the float subtraction
+        bits += 1 << 23;
+        bits = std::bit_cast<uint32_t>(std::bit_cast<float>(bits) - 0x1p-14f);
+    }
+    return std::bit_cast<float>(bits | uint32_t(half & 0x8000) << 16);
+}
+
+/// @brief How the channels of each texel are stored.
+enum class TexelFormat {
+    /// @brief 32 bit floats.
+    Float,
+    /// @brief 16 bit floats, for high dynamic range images (which are stored with at most this precision anyway).
+    Half,
+    /**
+     * @brief 8 bit values that are decoded by raising them to a gamma (as used by images with low dynamic range,
+     * which are stored in 8 bit with the sRGB transfer function).
+     */
+    Gamma8,
+};
+
+/**
+ * @brief Stores the texels of an image in square blocks, which lie in row-major order, while the texels within each
+ * block follow a Morton curve. The two by two texels of a bilinear lookup are thus mostly adjacent in memory (instead
+ * of being a row of the image apart), and lookups of nearby points stay within few cache lines.
+ * A block size of one yields the ordinary row-major layout.
+ * The texels are stored in a given @ref TexelFormat , and with a single channel if the image is grayscale.
+ */
+class TiledImage {
+    Point2i m_resolution;
+    /// @brief The logarithm of the side length of the blocks.
+    int m_log2BlockSize;
+    /// @brief The number of blocks per row (the resolution is padded to full blocks).
+    int m_blocksPerRow;
+    /// @brief Either 3 (for RGB) or 1 (for grayscale images).
+    int m_channels;
+    TexelFormat m_format;
+
+    /// @brief The texel data, of which only the vector matching @c m_format is used.
+    std::vector<float> m_floats;
+    std::vector<uint16_t> m_halves;
+    std::vector<uint8_t> m_bytes;
+    /// @brief The decoded value of every 8 bit value (for @ref TexelFormat::Gamma8 ).
+    std::array<float, 256> m_decode;
+
+    /// @brief Spreads the bits of a coordinate within a block apart (0b111 turns into 0b10101), up to 8x8 blocks.
+    static constexpr std::array<uint8_t, 8> SpreadBits = { 0b000000, 0b000001, 0b000100, 0b000101,
+                                                           0b010000, 0b010001, 0b010100, 0b010101 };
+
+    /// @brief Returns the 8 bit value whose decoded value is closest to @c value .
+    uint8_t encode(float value) const {
+        const auto upper = std::lower_bound(m_decode.begin(), m_decode.end(), value);
+        if (upper == m_decode.begin()) return 0;
+        if (upper == m_decode.end()) return 255;
+        const auto lower = upper - 1;
+        return uint8_t((value - *lower < *upper - value ? lower : upper) - m_decode.begin());
+    }
+
+    /// @brief Returns a channel of a texel, given the position of the channel in the texel data.
+    float fetch(size_t offset) const {
+        switch (m_format) {
+        case TexelFormat::Gamma8:
+            return m_decode[m_bytes[offset]];
+        case TexelFormat::Half:
+            return halfToFloat(m_halves[offset]);
+        default:
+            return m_floats[offset];
+        }
+    }
+
+public:
+    /// @brief The largest supported logarithm of the block size (blocks of 8x8 texels).
+    static constexpr int MaxLog2BlockSize = 3;
+
+    /**
+     * @brief Stores an image in a given block size and format.
+     * @param gamma The exponent that decodes 8 bit values (for @ref TexelFormat::Gamma8 ), matching the one the image
+     * has been loaded with so that its values are preserved exactly.
+     */
+    TiledImage(const Image &image, int log2BlockSize, TexelFormat format, float gamma = 1)
+    : m_resolution(image.resolution()), m_log2BlockSize(log2BlockSize), m_format(format) {
+        const int blockSize = 1 << m_log2BlockSize;
+        m_blocksPerRow = (m_resolution.x() + blockSize - 1) >> m_log2BlockSize;
+        const int blockRows = (m_resolution.y() + blockSize - 1) >> m_log2BlockSize;
+        const size_t texels = size_t(m_blocksPerRow) * blockRows << (2 * m_log2BlockSize);
+
+        const Color *begin = image.data();
+        const Color *end = begin + size_t(m_resolution.x()) * m_resolution.y();
+        m_channels = std::all_of(begin, end, [](const Color &c) { return c.r() == c.g() && c.g() == c.b(); }) ? 1 : 3;
+        if (m_format == TexelFormat::Half &&
+            std::any_of(begin, end, [](const Color &c) {
+                return !(std::abs(c.r()) < 65504.f && std::abs(c.g()) < 65504.f && std::abs(c.b()) < 65504.f);
+            })) {
+            // keep values that a half cannot hold
+            m_format = TexelFormat::Float;
+        }
+
+        // the same expression that stb_image uses to convert 8 bit images to floats
+        for (int i = 0; i < 256; i++) m_decode[i] = float(std::pow(double(i / 255.0f), double(gamma)));
+
+        switch (m_format) {
+        case TexelFormat::Gamma8: m_bytes.resize(texels * m_channels); break;
+        case TexelFormat::Half: m_halves.resize(texels * m_channels); break;
+        default: m_floats.resize(texels * m_channels); break;
+        }
+        for (int y = 0; y < m_resolution.y(); y++) {
+            for (int x = 0; x < m_resolution.x(); x++) {
+                const Color &color = image(Point2i(x, y));
+                const size_t offset = index(Point2i(x, y)) * m_channels;
+                for (int channel = 0; channel < m_channels; channel++) {
+                    switch (m_format) {
+                    case TexelFormat::Gamma8: m_bytes[offset + channel] = encode(color[channel]); break;
+                    case TexelFormat::Half: m_halves[offset + channel] = floatToHalf(color[channel]); break;
+                    default: m_floats[offset + channel] = color[channel]; break;
+                    }
+                }
+            }
+        }
+    }
+
+    /// @brief Returns where the texel at a given pixel coordinate is stored (in units of texels).
+    size_t index(const Point2i &pixel) const {
+        const int mask = (1 << m_log2BlockSize) - 1;
+        const size_t block = size_t(pixel.y() >> m_log2BlockSize) * m_blocksPerRow + (pixel.x() >> m_log2BlockSize);
+        return block << (2 * m_log2BlockSize) | SpreadBits[pixel.x() & mask] | SpreadBits[pixel.y() & mask] << 1;
+    }
+
+    /**
+     * @brief Returns the color at a given pixel coordinate in the range [0,0] to [resolution.x - 1, resolution.y - 1].
+     * @warning Pixel coordinates outside the specified range will result in undefined behavior!
+     */
+    Color get(const Point2i &pixel) const {
+        const size_t offset = index(pixel) * m_channels;
+        if (m_channels == 1) return Color(fetch(offset));
+        return Color(fetch(offset), fetch(offset + 1), fetch(offset + 2));
+    }
+
+    /// @brief Returns a single channel (0 to 2 for red to blue) of the color at a given pixel coordinate.
+    float get(const Point2i &pixel, int channel) const {
+        return fetch(index(pixel) * m_channels + (m_channels == 1 ? 0 : channel));
+    }
+
+    /**
+     * @brief Converts a normalized position from [0,0]..[+1,+1] to a pixel coordinate, clamping positions outside the
+     * unit square to the edges.
+     */
+    Point2i pixelFromNormalized(const Point2 &normalized) const {
+        return { std::clamp(int(normalized.x() * m_resolution.x()), 0, m_resolution.x() - 1),
+                 std::clamp(int(normalized.y() * m_resolution.y()), 0, m_resolution.y() - 1) };
+    }
+
+    /// @brief Returns the resolution of the image in pixels.
+    const Point2i &resolution() const { return m_resolution; }
+    /// @brief Returns the number of channels per texel (1 for grayscale images, 3 otherwise).
+    int channels() const { return m_channels; }
+    /// @brief Returns the format the texels are stored in.
+    TexelFormat format() const { return m_format; }
+    /// @brief Returns the number of bytes occupied by the texel data.
+    size_t bytes() const { return m_floats.size() * sizeof(float) + m_halves.size() * sizeof(uint16_t) + m_bytes.size(); }
+};
+
+}
@@ -0,0 +1,135 @@
+/**
+ * @file merge.cpp
+ * @brief Combines the partial images written by distributed lightwave workers (see the --tiles and --spp-range
+ * options of the renderer) into the final image.
+ *
+ * Each partial image stores the unnormalized sum of samples ("R", "G", "B") and the number of samples ("W") per pixel,
+ * so merging amounts to adding up all sums and weights and normalizing by the total weight. The result is saved in the
+ * same format as images produced by a single renderer process.
+ *
+ * Usage: merge <output.exr> <partial.exr>...
+ */
+
+#include <tinyexr.h>
+
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace {
+
+struct PartialImage {
+    int width = 0;
+    int height = 0;
+    /// @brief The channels "R", "G", "B" and "W" (in this order), each stored in scanline order.
+    std::vector<float> channels[4];
+};
+
+bool loadPartialImage(const char *path, PartialImage &result) {
+    const char *error = nullptr;
+    EXRVersion version;
+    if (ParseEXRVersionFromFile(&version, path) != TINYEXR_SUCCESS) {
+        std::fprintf(stderr, "could not read %s\n", path);
+        return false;
+    }
+
+    EXRHeader header;
+    InitEXRHeader(&header);
+    if (ParseEXRHeaderFromFile(&header, &version, path, &error) != TINYEXR_SUCCESS) {
+        std::fprintf(stderr, "could not read %s: %s\n", path, error);
+        FreeEXRErrorMessage(error);
+        return false;
+    }
+    for (int i = 0; i < header.num_channels; i++) {
+        header.requested_pixel_types[i] = TINYEXR_PIXELTYPE_FLOAT;
+    }
+
+    EXRImage image;
+    InitEXRImage(&image);
+    if (LoadEXRImageFromFile(&image, &header, path, &error) != TINYEXR_SUCCESS) {
+        std::fprintf(stderr, "could not read %s: %s\n", path, error);
+        FreeEXRErrorMessage(error);
+        FreeEXRHeader(&header);
+        return false;
+    }
+
+    const char *names[] = { "R", "G", "B", "W" };
+    bool success = true;
+    result.width = image.width;
+    result.height = image.height;
+    for (int c = 0; c < 4; c++) {
+        int index = -1;
+        for (int i = 0; i < header.num_channels; i++) {
+            if (std::strcmp(header.channels[i].name, names[c]) == 0) index = i;
+        }
+        if (index < 0) {
+            std::fprintf(stderr, "%s has no channel \"%s\", is it a partial image?\n", path, names[c]);
+            success = false;
+            break;
+        }
+        const float *data = reinterpret_cast<const float *>(image.images[index]);
+        result.channels[c].assign(data, data + size_t(image.width) * image.height);
+    }
+
+    FreeEXRImage(&image);
+    FreeEXRHeader(&header);
+    return success;
+}
+
+}
+
+int main(int argc, const char *argv[]) {
+    if (argc < 3) {
+        std::fprintf(stderr, "usage: %s <output.exr> <partial.exr>...\n", argv[0]);
+        return -1;
+    }
+
+    PartialImage total;
+    for (int i = 2; i < argc; i++) {
+        PartialImage partial;
+        if (!loadPartialImage(argv[i], partial)) return 1;
+
+        if (i == 2) {
+            total = std::move(partial);
+            continue;
+        }
+        if (partial.width != total.width || partial.height != total.height) {
+            std::fprintf(stderr, "resolution of %s does not match the other partial images\n", argv[i]);
+            return 1;
+        }
+        for (int c = 0; c < 4; c++) {
+            for (size_t p = 0; p < total.channels[c].size(); p++) {
+                total.channels[c][p] += partial.channels[c][p];
+            }
+        }
+    }
+
+    const size_t pixelCount = size_t(total.width) * total.height;
+    std::vector<float> rgb(3 * pixelCount);
+    size_t missingPixels = 0;
+    for (size_t p = 0; p < pixelCount; p++) {
+        const float weight = total.channels[3][p];
+        if (weight <= 0) {
+            missingPixels++;
+            continue;
+        }
+        // same normalization as the renderer uses (multiplication by the reciprocal sample count)
+        const float norm = 1.0f / weight;
+        for (int c = 0; c < 3; c++) {
+            rgb[3 * p + c] = norm * total.channels[c][p];
+        }
+    }
+    if (missingPixels) {
+        std::fprintf(stderr, "warning: %zu pixels have not been rendered by any worker\n", missingPixels);
+    }
+
+    const char *error = nullptr;
+    if (SaveEXR(rgb.data(), total.width, total.height, 3, true, argv[1], &error) != TINYEXR_SUCCESS) {
+        std::fprintf(stderr, "could not save %s: %s\n", argv[1], error);
+        FreeEXRErrorMessage(error);
+        return 1;
+    }
+    std::printf("merged %d partial images into %s\n", argc - 2, argv[1]);
+    return 0;
+}